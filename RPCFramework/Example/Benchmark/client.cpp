@@ -0,0 +1,70 @@
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <deque>
+#include <atomic>
+#include <chrono>
+#include "RPCClient.hpp"
+
+// 每个线程一个连接，保持 window 个未完成的异步调用，统计吞吐量
+void benchmark(const std::string& ip, uint16_t port, size_t calls, size_t window, size_t payload, std::atomic<size_t>& failed)
+{
+    try
+    {
+        RPCClient clnt(ip, port);
+        std::string data(payload, 'x');
+        std::deque<RPCFuture<std::string>> inflight;
+        for(size_t i = 0; i < calls; ++i)
+        {
+            if(inflight.size() >= window)
+            {
+                if(inflight.front().get().size() != payload)
+                    ++failed;
+                inflight.pop_front();
+            }
+            inflight.push_back(clnt.asyncRemoteCall<std::string>("echo", data));
+        }
+        while(!inflight.empty())
+        {
+            if(inflight.front().get().size() != payload)
+                ++failed;
+            inflight.pop_front();
+        }
+    }
+    catch(const std::exception& e)
+    {
+        std::cerr << e.what() << '\n';
+        ++failed;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    if(argc != 7)
+    {
+        // e.g: ./client 127.0.0.1 1145 8 100000 32 64
+        std::cerr << "Usage: [ip][port][threads][calls per thread][window][payload size]" << std::endl;
+        return -1;
+    }
+    std::string ip(argv[1]);
+    uint16_t port = std::stoi(argv[2]);
+    size_t threadNum = std::stoul(argv[3]);
+    size_t calls = std::stoul(argv[4]);
+    size_t window = std::stoul(argv[5]);
+    size_t payload = std::stoul(argv[6]);
+
+    std::atomic<size_t> failed(0);
+    std::vector<std::thread> threads;
+    auto start = std::chrono::steady_clock::now();
+    for(size_t i = 0; i < threadNum; ++i)
+        threads.emplace_back(benchmark, ip, port, calls, window, payload, std::ref(failed));
+    for(auto& t : threads)
+        t.join();
+    auto end = std::chrono::steady_clock::now();
+
+    double seconds = std::chrono::duration<double>(end - start).count();
+    size_t total = threadNum * calls;
+    std::cout << "Total calls: " << total << ", failed: " << failed << std::endl;
+    std::cout << "Total cost time(ms): " << static_cast<long long>(seconds * 1000) << std::endl;
+    std::cout << "Throughput(calls/s): " << static_cast<long long>(total / seconds) << std::endl;
+}
@@ -0,0 +1,70 @@
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include "RPCFramework.hpp"
+#include "RPCClient.hpp"
+
+// 进程内调用的基准：typed 不经过序列化，encoded 经过编码但不经过 socket
+void benchmark(RPCFramework& framework, bool typed, size_t calls, size_t payload, std::atomic<size_t>& failed)
+{
+    try
+    {
+        RPCClient clnt(framework);
+        std::string data(payload, 'x');
+        for(size_t i = 0; i < calls; ++i)
+        {
+            std::string ret = typed ? clnt.remoteCall<std::string>("echo", data)
+                                    : clnt.asyncRemoteCall<std::string>("echo", data).get();
+            if(ret.size() != payload)
+                ++failed;
+        }
+    }
+    catch(const std::exception& e)
+    {
+        std::cerr << e.what() << '\n';
+        ++failed;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    if(argc != 5)
+    {
+        // e.g: ./local typed 8 1000000 32
+        std::cerr << "Usage: [typed|encoded][threads][calls per thread][payload size]" << std::endl;
+        return -1;
+    }
+    std::string mode(argv[1]);
+    if(mode != "typed" && mode != "encoded")
+    {
+        std::cerr << "No such mode, available mode: typed, encoded" << std::endl;
+        return -1;
+    }
+    size_t threadNum = std::stoul(argv[2]);
+    size_t calls = std::stoul(argv[3]);
+    size_t payload = std::stoul(argv[4]);
+
+    RPCFramework framework;
+    framework.registerProcedure("echo", std::function<std::string(std::string)>([](std::string data)
+    {
+        return data;
+    }));
+    framework.freeze();
+
+    std::atomic<size_t> failed(0);
+    std::vector<std::thread> threads;
+    auto start = std::chrono::steady_clock::now();
+    for(size_t i = 0; i < threadNum; ++i)
+        threads.emplace_back(benchmark, std::ref(framework), mode == "typed", calls, payload, std::ref(failed));
+    for(auto& t : threads)
+        t.join();
+    auto end = std::chrono::steady_clock::now();
+
+    double seconds = std::chrono::duration<double>(end - start).count();
+    size_t total = threadNum * calls;
+    std::cout << "Total calls: " << total << ", failed: " << failed << std::endl;
+    std::cout << "Total cost time(ms): " << static_cast<long long>(seconds * 1000) << std::endl;
+    std::cout << "Throughput(calls/s): " << static_cast<long long>(total / seconds) << std::endl;
+}
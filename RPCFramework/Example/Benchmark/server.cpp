@@ -0,0 +1,42 @@
+#include <iostream>
+#include "RPCServer.hpp"
+
+// 性能测试的服务端，可以选择 reactor 的实现方式
+int main(int argc, char* argv[])
+{
+    if(argc < 4)
+    {
+        // e.g: ./server 127.0.0.1 1145 uring 4
+        std::cerr << "Usage: [ip][port][epoll|uring][reactor_nums]" << std::endl;
+        return -1;
+    }
+    std::string backend(argv[3]);
+    if(backend != "epoll" && backend != "uring")
+    {
+        std::cerr << "No such backend, available backend: epoll, uring" << std::endl;
+        return -1;
+    }
+
+    RPCServerOptions options;
+    options.backlog = 60000;
+    options.backend = backend == "uring" ? ReactorBackend::IO_URING : ReactorBackend::EPOLL;
+    if(argc > 4)
+        options.reactor_nums = std::stoi(argv[4]);
+    RPCServer server(argv[1], std::stoi(argv[2]), options);
+
+    server.registerProcedure("add", std::function<int(int, int)>([](int a, int b)
+    {
+        return a + b;
+    }));
+    server.registerProcedure("echo", std::function<std::string(std::string)>([](std::string s)
+    {
+        return s;
+    }));
+
+    server.start();
+
+    // 写出的统计：平均每次系统调用写出的响应数
+    RPCServerStats stats = server.stats();
+    std::cout << "backend: " << backend << ", responses: " << stats.responses << ", send calls: " << stats.flushes
+              << ", responses per send: " << stats.batching() << std::endl;
+}
@@ -20,6 +20,7 @@ void testBasicFeature(const std::string& ip, uint16_t port)
         std::cout << clnt.remoteCall<int>("Foo::test1", 1, 17) << std::endl;                                      // member function
         std::cout << clnt.remoteCall<std::string>("hello") << std::endl;                                          // std::string return typr
         clnt.remoteCall<void>("testString", 1, std::string("hello, server!"), 1.1, std::string("RPC Framework")); // std::string parma
+        std::cout << clnt.remoteCall<size_t>("testStringView", std::string("hello, server!"), 'l') << std::endl;   // std::string_view parma
 
         People HeXin;
         HeXin = clnt.remoteCall<People>("getHeXin", HeXin); // Parameters and return types are custom types
@@ -46,6 +47,155 @@ void testBasicFeature(const std::string& ip, uint16_t port)
     }
 }
 
+// 测试 pipelining：同一连接上连续发出多个请求，先发出的请求执行得更久，响应乱序到达，仍然各自得到自己的结果；三种编码方式都测试一遍
+void testPipelining(const std::string& ip, uint16_t port)
+{
+    for(Codec codec : {Codec::TEXT, Codec::BINARY, Codec::VARINT})
+    {
+        try
+        {
+            RPCClient clnt(ip, port, codec);
+            const int n = 8; // 不超过服务端每个 reactor 的工作线程数，所有请求同时执行
+            auto start = std::chrono::steady_clock::now();
+            std::vector<RPCFuture<int>> futures;
+            for(int i = 0; i < n; ++i)
+                futures.push_back(clnt.asyncRemoteCall<int>("sleepFor", (n - i) * 20)); // 最后发出的最先完成
+            auto hello = clnt.asyncRemoteCall<std::string>("hello");
+            auto sum = clnt.asyncRemoteCall<int>("getSum", std::vector<int>{1, 2, 3, 4});
+
+            int matched = 0;
+            for(int i = 0; i < n; ++i)
+                if(futures[i].get() == (n - i) * 20)
+                    ++matched;
+            bool others = hello.get() == "hello, clnt!\nhahaha" && sum.get() == 10;
+            auto cost = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+            std::cout << static_cast<char>(codec) << ": matched " << matched << "/" << n << (others ? "" : ", other results mismatched")
+                      << ", cost(ms): " << cost << std::endl; // 约为最久的一个请求的时间，而不是所有请求的总和
+        }
+        catch(const std::exception& e)
+        {
+            std::cerr << e.what() << '\n';
+        }
+    }
+}
+
+// 测试超时：超时的调用抛出异常，之后同一连接上的调用不受影响；过程中可以得到调用的剩余时间
+void testDeadline(const std::string& ip, uint16_t port)
+{
+    RPCClient clnt(ip, port);
+    try
+    {
+        clnt.remoteCall<int>(std::chrono::milliseconds(200), "testTimeOut"); // 服务端需要 5s
+        std::cerr << "testTimeOut: not timed out" << std::endl;
+    }
+    catch(const std::exception& e)
+    {
+        std::cout << "testTimeOut: " << e.what() << std::endl; // remoteCall: timeout
+    }
+
+    try
+    {
+        std::cout << clnt.remoteCall<int>("add", 1, 1) << std::endl;                                                 // 超时的请求的响应之后到达时被丢弃
+        std::cout << "remaining: " << clnt.remoteCall<long long>(std::chrono::milliseconds(1000), "testRemaining") << std::endl; // 略小于 1000
+        std::cout << "remaining: " << clnt.remoteCall<long long>("testRemaining") << std::endl;                      // 没有期限，-1
+    }
+    catch(const std::exception& e)
+    {
+        std::cerr << e.what() << '\n';
+    }
+}
+
+/**
+ * @brief 在同一连接上连续发出 callNum 个执行 sleepMs 毫秒的请求，统计成功的与收到错误码 4（OVERLOADED）的个数，之后再发出一个普通的请求
+ * 
+ * 服务端应当丢弃一部分请求、完成其余的请求，积压消失后恢复正常：两者都大于 0、之后的请求成功时输出 OK
+ */
+void testShedding(const std::string& ip, uint16_t port, int callNum, int sleepMs)
+{
+    RPCClient clnt(ip, port);
+    std::vector<RPCFuture<int>> futures;
+    for(int i = 0; i < callNum; ++i)
+        futures.push_back(clnt.asyncRemoteCall<int>("sleepFor", sleepMs));
+
+    int succeeded = 0, overloaded = 0;
+    for(auto &future : futures)
+    {
+        try
+        {
+            future.get();
+            ++succeeded;
+        }
+        catch(const std::exception& e)
+        {
+            std::string what = e.what();
+            if(what.find("error code: 4") != std::string::npos)
+                ++overloaded;
+            else
+                std::cerr << what << '\n';
+        }
+    }
+
+    bool recovered = false;
+    try
+    {
+        recovered = clnt.remoteCall<int>("add", 1, 1) == 2;
+    }
+    catch(const std::exception& e)
+    {
+        std::cerr << e.what() << '\n';
+    }
+    std::cout << "succeeded: " << succeeded << ", overloaded: " << overloaded << ", recovered: " << (recovered ? "yes" : "no")
+              << (succeeded > 0 && overloaded > 0 && recovered ? " -> OK" : " -> expected succeeded > 0, overloaded > 0 and recovered") << std::endl;
+}
+
+// 测试过载（服务端以 ./server queue 启动）：任务队列已满时请求被拒绝，收到错误码 4（OVERLOADED），队列排空后恢复正常
+void testOverload(const std::string& ip, uint16_t port)
+{
+    testShedding(ip, port, 10, 100); // 1 个在执行，2 个在排队，其余被拒绝
+}
+
+// 测试基于排队时间的准入控制（服务端以 ./server codel 启动）：请求持续积压时，排队过久的请求收到错误码 4（OVERLOADED），
+// 新的请求仍然能够完成；积压消失后恢复正常
+void testQueueDelay(const std::string& ip, uint16_t port)
+{
+    testShedding(ip, port, 40, 20); // 共 800ms 的工作，远超 50ms 的目标
+}
+
+// 测试连接管理（服务端以 ./server limit 启动）：超过最大连接数的连接被立即关闭，空闲的连接被关闭，之后新的连接不受影响
+void testConnectionLimit(const std::string& ip, uint16_t port)
+{
+    auto call = [](RPCClient &clnt, const std::string &name)
+    {
+        try
+        {
+            int res = clnt.remoteCall<int>("add", 1, 1);
+            std::cout << name << ": " << res << std::endl;
+        }
+        catch(const std::exception& e)
+        {
+            std::cout << name << ": " << e.what() << std::endl; // 连接已被服务端关闭
+        }
+    };
+
+    std::unique_ptr<RPCClient> first(new RPCClient(ip, port)), second(new RPCClient(ip, port));
+    call(*first, "first");
+    call(*second, "second");
+    {
+        RPCClient third(ip, port);
+        call(third, "third"); // 超过 max_connections
+    }
+
+    second.reset();
+    std::this_thread::sleep_for(std::chrono::milliseconds(100)); // 等待服务端关闭连接
+    RPCClient fourth(ip, port);
+    call(fourth, "fourth");
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(1000)); // 超过 idle_timeout
+    call(*first, "first after idle");
+    RPCClient fifth(ip, port);
+    call(fifth, "fifth");
+}
+
 // 测试同时能连接的最大数量
 void testMaxConnections(const std::string& ip, uint16_t port, size_t taskNum)
 {
@@ -52,9 +52,29 @@ int main(int argc, char* argv[])
             testConcurrency_1(ip, port, threadNum, clntNum);
             break;
         }
+        case 4:
+            start = std::chrono::steady_clock::now();
+            testDeadline(ip, port);
+            break;
+        case 5:
+            start = std::chrono::steady_clock::now();
+            testOverload(ip, port);
+            break;
+        case 6:
+            start = std::chrono::steady_clock::now();
+            testQueueDelay(ip, port);
+            break;
+        case 7:
+            start = std::chrono::steady_clock::now();
+            testConnectionLimit(ip, port);
+            break;
+        case 8:
+            start = std::chrono::steady_clock::now();
+            testPipelining(ip, port);
+            break;
         default:
             start = std::chrono::steady_clock::now();
-            std::cout << "No such opinion, available opinion: 0, 1, 2, 3" << std::endl;
+            std::cout << "No such opinion, available opinion: 0, 1, 2, 3, 4, 5, 6, 7, 8" << std::endl;
             break;
         }
     }
@@ -7,6 +7,8 @@
 #include <unordered_map>
 #include <algorithm>
 #include <numeric>
+#include <string_view>
+#include "RPCContext.hpp"
 #include "TestClass.hpp"
 
 int sub(int a, int b)
@@ -37,6 +39,11 @@ void testString(int a, std::string s1, double b, std::string s2)
               << "s2 = " << s2 << "\n";
 }
 
+size_t testStringView(std::string_view s, char c) // 测试零拷贝的 std::string_view 参数
+{
+    return std::count(s.begin(), s.end(), c);
+}
+
 void testExcp(void)
 {
     throw std::runtime_error("in excp, test exception..");
@@ -48,6 +55,20 @@ int testTimeOut(void)
     return 114514;
 }
 
+int sleepFor(int ms) // 测试执行时间不同的请求
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+    return ms;
+}
+
+long long testRemaining(void) // 测试在过程中得到调用的剩余时间（毫秒），没有期限时返回 -1
+{
+    const RPCContext *ctx = RPCContext::current();
+    if (ctx == nullptr || !ctx->hasDeadline())
+        return -1;
+    return std::chrono::duration_cast<std::chrono::milliseconds>(ctx->remaining()).count();
+}
+
 int getSum(std::vector<int> nums) // 测试对 vector 容器的支持
 {
     return std::accumulate(nums.begin(), nums.end(), 0);
@@ -2,9 +2,31 @@
 #include "TestClass.hpp"
 #include "Procedures.hpp"
 
-int main(void)
+// 不带参数时使用默认配置；其它配置用于客户端对应的测试（见 Test.hpp）
+//   ./server queue：每个 sub reactor 只有 1 个工作线程，最多排队 2 个请求
+//   ./server codel：每个 sub reactor 只有 1 个工作线程，排队时间持续超过 50ms 时认为过载
+//   ./server limit：最多 2 个连接，空闲超过 500ms 的连接被关闭
+int main(int argc, char* argv[])
 {
-    RPCServer server("192.168.124.114", 1145, 60000);
+    RPCServerOptions options;
+    options.backlog = 60000;
+    std::string config = argc > 1 ? argv[1] : "";
+    if (config == "queue")
+    {
+        options.task_thread_nums = 1;
+        options.queue_capacity = 2;
+    }
+    else if (config == "codel")
+    {
+        options.task_thread_nums = 1;
+        options.queue_delay_target = 50;
+    }
+    else if (config == "limit")
+    {
+        options.max_connections = 2;
+        options.idle_timeout = 500;
+    }
+    RPCServer server("192.168.124.114", 1145, options);
 
     std::function<int(int, int)> add = [](int a, int b)
     {
@@ -22,8 +44,11 @@ int main(void)
     server.registerProcedure("hello", hello);               // 测试对 std::string 返回类型的支持
     server.registerProcedure("getHeXin", getHeXin);         // 测试参数、返回值类型为自定义类型的情况
     server.registerProcedure("testString", testString);     // 测试参数中含有 std::string 的情况
+    server.registerProcedure("testStringView", testStringView); // 测试参数中含有 std::string_view 的情况
     server.registerProcedure("testExcp", testExcp);         // 测试在函数中，抛出异常的情况
     server.registerProcedure("testTimeOut", testTimeOut);   // 测试函数运行时间过长的情况
+    server.registerProcedure("testRemaining", testRemaining); // 测试在函数中得到调用的剩余时间
+    server.registerProcedure("sleepFor", sleepFor);         // 测试执行时间不同的函数
     server.registerProcedure("getSum", getSum);             // 测试对容器的支持
     server.registerProcedure("twoSum", twoSum);             // 测试对容器的支持
     server.registerProcedure("getManyHeXin", getManyHeXin); // 测试容器内存储自定义类型的支持
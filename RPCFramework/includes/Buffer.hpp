@@ -0,0 +1,234 @@
+#pragma once
+
+#include <streambuf>
+#include <string>
+#include <algorithm>
+#include <cstring>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <mutex>
+
+/**
+ * @brief 只读的流缓冲区，直接引用外部的一段内存（例如服务端收到的整个请求），不做任何拷贝
+ *
+ * 反序列化 std::string_view、std::span 时，得到的视图直接指向这段内存，
+ * 因此，在视图使用完毕之前，调用者需要保证这段内存有效
+ *
+ */
+class ViewBuffer : public std::streambuf
+{
+public:
+    ViewBuffer() = default;
+
+    ViewBuffer(const char *data, size_t len)
+    {
+        reset(data, len);
+    }
+
+    // 改为引用另一段内存，使同一个 ViewBuffer（以及绑定它的 istream）可以重复使用
+    void reset(const char *data, size_t len)
+    {
+        char *begin = const_cast<char *>(data); // 只会读取，不会写入
+        setg(begin, begin, begin + len);
+    }
+
+    // 当前读取位置
+    const char *current() const
+    {
+        return gptr();
+    }
+
+    // 剩余未读取的字节数
+    size_t remaining() const
+    {
+        return egptr() - gptr();
+    }
+
+    // 跳过 n 个字节，剩余字节不足时返回 false
+    bool skip(size_t n)
+    {
+        if (n > remaining())
+            return false;
+        setg(eback(), gptr() + n, egptr());
+        return true;
+    }
+
+protected:
+    std::streamsize showmanyc() override
+    {
+        return remaining();
+    }
+
+    // 文本编码中使用 seekg 跳过分隔符，因此需要支持定位
+    pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) override
+    {
+        if (!(which & std::ios_base::in))
+            return pos_type(off_type(-1));
+
+        char *base = dir == std::ios_base::beg ? eback() : (dir == std::ios_base::cur ? gptr() : egptr());
+        char *target = base + off;
+        if (target < eback() || target > egptr())
+            return pos_type(off_type(-1));
+        setg(eback(), target, egptr());
+        return pos_type(target - eback());
+    }
+
+    pos_type seekpos(pos_type pos, std::ios_base::openmode which) override
+    {
+        return seekoff(off_type(pos), std::ios_base::beg, which);
+    }
+};
+
+/**
+ * @brief 可写的流缓冲区，直接写入外部的 std::string，不像 std::ostringstream 那样需要在最后拷贝一次
+ *
+ * 写入期间 target 的长度可能大于实际写入的长度，写入完成后需要调用 finish
+ * 支持 seekp，可以先预留空间，写完后再回填（例如长度前缀）
+ *
+ */
+class WriteBuffer : public std::streambuf
+{
+    std::string *target = nullptr;
+    size_t written = 0; // 写入过的最远位置，seekp 回退后，用于确定实际写入的长度
+
+public:
+    WriteBuffer() = default;
+
+    // 从 target 的末尾开始追加
+    explicit WriteBuffer(std::string &target)
+    {
+        attach(target);
+    }
+
+    // 改为写入另一个 std::string，使同一个 WriteBuffer（以及绑定它的 ostream）可以重复使用
+    void attach(std::string &target)
+    {
+        this->target = &target;
+        written = target.size();
+        target.resize(std::max<size_t>(target.capacity(), written + 64));
+        reset(written);
+    }
+
+    // 已写入的字节数
+    size_t size() const
+    {
+        return std::max<size_t>(written, pptr() - pbase());
+    }
+
+    // 写入完成，将 target 截断为实际写入的长度
+    std::string &finish()
+    {
+        written = size();
+        target->resize(written);
+        setp(nullptr, nullptr);
+        return *target;
+    }
+
+protected:
+    int_type overflow(int_type ch) override
+    {
+        if (traits_type::eq_int_type(ch, traits_type::eof()))
+            return traits_type::not_eof(ch);
+        grow(1);
+        *pptr() = traits_type::to_char_type(ch);
+        pbump(1);
+        return ch;
+    }
+
+    std::streamsize xsputn(const char *s, std::streamsize n) override
+    {
+        if (epptr() - pptr() < n)
+            grow(n);
+        std::memcpy(pptr(), s, n);
+        advance(n);
+        return n;
+    }
+
+    pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) override
+    {
+        if (!(which & std::ios_base::out))
+            return pos_type(off_type(-1));
+        written = size();
+        off_type base = dir == std::ios_base::beg ? 0 : (dir == std::ios_base::cur ? pptr() - pbase() : written);
+        off_type pos = base + off;
+        if (pos < 0 || static_cast<size_t>(pos) > written)
+            return pos_type(off_type(-1));
+        reset(pos);
+        return pos_type(pos);
+    }
+
+    pos_type seekpos(pos_type pos, std::ios_base::openmode which) override
+    {
+        return seekoff(off_type(pos), std::ios_base::beg, which);
+    }
+
+private:
+    // 确保当前位置之后至少还有 n 个字节的空间，容量按 2 倍增长
+    void grow(size_t n)
+    {
+        size_t pos = pptr() - pbase();
+        written = size();
+        target->resize(std::max(target->size() * 2, pos + n));
+        reset(pos);
+    }
+
+    void reset(size_t pos)
+    {
+        setp(&(*target)[0], &(*target)[0] + target->size());
+        advance(pos);
+    }
+
+    // pbump 的参数为 int，需要分段移动
+    void advance(size_t n)
+    {
+        while (n > 0)
+        {
+            int step = static_cast<int>(std::min<size_t>(n, INT32_MAX));
+            pbump(step);
+            n -= step;
+        }
+    }
+};
+
+/**
+ * @brief 缓冲区池，回收 std::string 的容量，稳定运行时收发小消息不再需要分配内存
+ *
+ * 可以跨线程使用：例如 reactor 获取请求缓冲区，工作线程处理完请求后归还
+ *
+ */
+class BufferPool
+{
+    std::mutex lock;
+    std::vector<std::string> buffers;
+    size_t maxBuffers;    // 最多缓存的缓冲区数量
+    size_t maxCapacity;   // 容量超过该值的缓冲区不回收，避免偶尔的大消息长期占用内存
+
+public:
+    static constexpr size_t DEFAULT_MAX_BUFFERS = 256;
+    static constexpr size_t DEFAULT_MAX_CAPACITY = 64 * 1024;
+
+    BufferPool(size_t maxBuffers = DEFAULT_MAX_BUFFERS, size_t maxCapacity = DEFAULT_MAX_CAPACITY)
+        : maxBuffers(maxBuffers), maxCapacity(maxCapacity) {}
+
+    // 获取一个空的缓冲区，尽可能复用之前归还的容量
+    std::string acquire()
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (buffers.empty())
+            return std::string();
+        std::string buf = std::move(buffers.back());
+        buffers.pop_back();
+        return buf;
+    }
+
+    void release(std::string &&buf)
+    {
+        if (buf.capacity() > maxCapacity)
+            return;
+        buf.clear();
+        std::lock_guard<std::mutex> guard(lock);
+        if (buffers.size() < maxBuffers)
+            buffers.push_back(std::move(buf));
+    }
+};
@@ -0,0 +1,201 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <string>
+#include <cerrno>
+#include <cstdint>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+/**
+ * @brief 帧格式：[ 4 字节长度（网络字节序，不含帧头）][ 数据 ]
+ *
+ */
+struct Frame
+{
+    static constexpr size_t HEADER_SIZE = sizeof(uint32_t);
+
+    // 在 buf 的开头预留帧头，数据写完后再调用 finish 回填长度
+    static void reserve(std::string &buf)
+    {
+        buf.assign(HEADER_SIZE, '\0');
+    }
+
+    // 根据 buf 的实际长度回填帧头
+    static void finish(std::string &buf)
+    {
+        uint32_t len = htonl(static_cast<uint32_t>(buf.size() - HEADER_SIZE));
+        std::memcpy(&buf[0], &len, HEADER_SIZE);
+    }
+
+    // 解析帧头，返回数据的长度
+    static uint32_t parse(const char *header)
+    {
+        uint32_t len;
+        std::memcpy(&len, header, HEADER_SIZE);
+        return ntohl(len);
+    }
+};
+
+/**
+ * @brief 增量的帧解码器，每个连接一个，用于边缘触发（EPOLLET）的非阻塞 socket
+ *
+ * readFrom 读取到 EAGAIN，或者读满 budget 个字节，next 依次取出所有完整的帧，不完整的帧保留到下一次读事件，
+ * 读到一半的帧不会阻塞 reactor；读满 budget 时 socket 中可能还有数据，边缘触发不会再次通知，由调用者之后继续读取
+ *
+ */
+class FrameDecoder
+{
+public:
+    enum class Status
+    {
+        AGAIN,  // 数据已读完（EAGAIN），等待下一次读事件
+        MORE,   // 已读满 budget，可能还有数据，需要继续读取
+        CLOSED, // 对端关闭了连接
+        ERROR   // recv 出错，或者帧的长度超过上限
+    };
+
+    static constexpr size_t READ_CHUNK = 16 * 1024;         // 每次 recv 至少预留的空间
+    static constexpr uint32_t DEFAULT_MAX_FRAME = 64 << 20; // 默认单个帧的最大长度
+
+    explicit FrameDecoder(uint32_t maxFrame = DEFAULT_MAX_FRAME)
+        : maxFrame(maxFrame) {}
+
+    // 读取 fd 中的数据，直到 EAGAIN、对端关闭、出错，或者读满 budget 个字节
+    Status readFrom(int fd, size_t budget = SIZE_MAX);
+
+    // 追加已经收到的数据（例如 io_uring 完成的 recv），帧超长时返回 false
+    bool feed(const char *data, size_t len);
+
+    // 取出下一个完整的帧（不含帧头），写入 payload（覆盖原有内容），没有完整的帧时返回 false
+    bool next(std::string &payload);
+
+    // 收到了超长的帧，连接应当关闭
+    bool failed() const
+    {return oversized;}
+
+    // 丢弃所有数据，回到初始状态，保留缓冲区的容量（连接对象被新的连接复用时）
+    void reset()
+    {
+        head = tail = 0;
+        state = State::HEADER;
+        expected = 0;
+        oversized = false;
+    }
+
+private:
+    enum class State
+    {
+        HEADER, // 等待帧头
+        BODY    // 帧头已解析，等待 expected 个字节的数据
+    };
+
+    std::string buffer;        // 接收缓冲区，[head, tail) 为未处理的数据
+    size_t head = 0;
+    size_t tail = 0;
+    State state = State::HEADER;
+    uint32_t expected = 0;     // 当前帧数据部分的长度
+    uint32_t maxFrame;
+    bool oversized = false;    // 收到超长的帧，连接应当关闭
+
+    // 将未处理的数据移动到缓冲区开头，并确保至少有 READ_CHUNK 的空闲空间
+    void compact();
+
+    // 提前检查帧头，超长的帧不必等到接收完再拒绝
+    void check();
+};
+
+inline FrameDecoder::Status FrameDecoder::readFrom(int fd, size_t budget)
+{
+    size_t got = 0;
+    while (true)
+    {
+        if (oversized)
+            return Status::ERROR;
+        if (got >= budget)
+            return Status::MORE;
+
+        compact();
+        ssize_t n = recv(fd, &buffer[tail], std::min(buffer.size() - tail, budget - got), 0);
+        if (n > 0)
+        {
+            tail += n;
+            got += n;
+            check();
+            continue;
+        }
+        if (n == 0)
+            return Status::CLOSED;
+        if (errno == EINTR)
+            continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+            return Status::AGAIN;
+        return Status::ERROR;
+    }
+}
+
+inline bool FrameDecoder::feed(const char *data, size_t len)
+{
+    while (len > 0 && !oversized)
+    {
+        compact();
+        size_t n = std::min(len, buffer.size() - tail);
+        std::memcpy(&buffer[tail], data, n);
+        tail += n;
+        data += n;
+        len -= n;
+        check();
+    }
+    return !oversized;
+}
+
+inline bool FrameDecoder::next(std::string &payload)
+{
+    if (state == State::HEADER)
+    {
+        if (tail - head < Frame::HEADER_SIZE)
+            return false;
+        expected = Frame::parse(&buffer[head]);
+        if (expected > maxFrame)
+        {
+            oversized = true;
+            return false;
+        }
+        head += Frame::HEADER_SIZE;
+        state = State::BODY;
+    }
+
+    if (tail - head < expected)
+        return false;
+    payload.assign(&buffer[head], expected);
+    head += expected;
+    state = State::HEADER;
+    if (head == tail)
+        head = tail = 0;
+    return true;
+}
+
+inline void FrameDecoder::compact()
+{
+    if (head > 0 && buffer.size() - tail < READ_CHUNK)
+    {
+        std::memmove(&buffer[0], &buffer[head], tail - head);
+        tail -= head;
+        head = 0;
+    }
+    // 已知帧的长度时，一次性预留足够的空间，避免大帧反复扩容
+    size_t want = tail + READ_CHUNK;
+    if (state == State::BODY && head + expected > want)
+        want = head + expected;
+    if (buffer.size() < want)
+        buffer.resize(std::max(want, buffer.size() * 2));
+}
+
+inline void FrameDecoder::check()
+{
+    if (state == State::HEADER && tail - head >= Frame::HEADER_SIZE
+        && Frame::parse(&buffer[head]) > maxFrame)
+        oversized = true;
+}
@@ -0,0 +1,385 @@
+#pragma once
+
+#include <stdexcept>
+#include <string>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <cerrno>
+#include <csignal>
+#include <ctime>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+/**
+ * @brief io_uring 的最小封装，直接使用系统调用，不依赖 liburing
+ *
+ * 只能在一个线程中使用：提交、收割都由所属的 reactor 线程完成
+ * 提交队列满时，get_sqe 会先把已经准备好的请求提交给内核
+ *
+ */
+class IOUring
+{
+public:
+    /**
+     * @brief 创建 io_uring 实例
+     *
+     * @param entries 提交队列的大小，完成队列为它的 4 倍
+     * @param disabled 为 true 时先不启用，之后在使用它的线程中调用 enable，
+     *                 这样可以在构造函数中创建（创建失败时抛出异常），在 reactor 线程中使用
+     */
+    explicit IOUring(unsigned entries, bool disabled = false);
+    ~IOUring();
+
+    IOUring(const IOUring &) = delete;
+    IOUring &operator=(const IOUring &) = delete;
+
+    // 启用以 disabled 方式创建的实例，调用的线程成为唯一的提交者
+    void enable();
+
+    // 获取一个空的 sqe，已清零
+    io_uring_sqe *get_sqe();
+
+    // 提交队列中还能放入的 sqe 数
+    unsigned space() const
+    {return sq_entries - (sq_tail - __atomic_load_n(sq_khead, __ATOMIC_ACQUIRE));}
+
+    // 提交已经准备好的请求，不等待完成
+    int submit();
+
+    // 提交已经准备好的请求，并等待至少一个完成，最多等待 timeout_ms 毫秒；超时或被信号中断时返回 0
+    int submit_and_wait(int timeout_ms);
+
+    // 依次处理所有已完成的 cqe，返回处理的个数
+    template <typename Func>
+    unsigned for_each_cqe(Func func);
+
+    int fd() const
+    {return ring_fd;}
+
+    /* 准备常用的请求，user_data 由调用者设置 */
+    static void prep_accept_multishot(io_uring_sqe *sqe, int fd, int flags);
+    static void prep_recv_multishot(io_uring_sqe *sqe, int fd, uint16_t buf_group);
+    static void prep_sendmsg(io_uring_sqe *sqe, int fd, const msghdr *msg, int flags);
+    static void prep_read(io_uring_sqe *sqe, int fd, void *buf, unsigned len);
+    static void prep_cancel_all(io_uring_sqe *sqe); // 取消所有进行中的请求
+
+private:
+    int ring_fd = -1;
+    unsigned features = 0;
+    unsigned pending = 0; // 已经准备、还未提交的 sqe 数
+
+    // 提交队列
+    void *sq_ptr = nullptr;
+    size_t sq_size = 0;
+    unsigned *sq_khead = nullptr;
+    unsigned *sq_ktail = nullptr;
+    unsigned sq_mask = 0;
+    unsigned sq_entries = 0;
+    unsigned sq_tail = 0; // 本地的 tail，提交时才写回内核
+    io_uring_sqe *sqes = nullptr;
+    size_t sqes_size = 0;
+
+    // 完成队列，与提交队列共用一块映射（IORING_FEAT_SINGLE_MMAP）时，cq_ptr 等于 sq_ptr
+    void *cq_ptr = nullptr;
+    size_t cq_size = 0;
+    unsigned *cq_khead = nullptr;
+    unsigned *cq_ktail = nullptr;
+    unsigned cq_mask = 0;
+    io_uring_cqe *cqes = nullptr;
+
+    int enter(unsigned to_submit, unsigned min_complete, unsigned flags, const void *arg, size_t argsz);
+
+    static void prep(io_uring_sqe *sqe, uint8_t opcode, int fd, uint64_t addr, unsigned len);
+};
+
+/**
+ * @brief 提供给内核的缓冲区环（provided buffer ring），用于 multishot recv
+ *
+ * 内核在数据到达时才从环中取出一个缓冲区，连接空闲时不占用内存
+ * 处理完 cqe 中的数据后，调用 recycle 归还缓冲区
+ *
+ */
+class BufferRing
+{
+public:
+    /**
+     * @param ring  所属的 io_uring
+     * @param group 缓冲区组的编号，recv 时通过它选择缓冲区
+     * @param count 缓冲区的数量，必须是 2 的幂
+     * @param size  每个缓冲区的大小
+     */
+    BufferRing(IOUring &ring, uint16_t group, unsigned count, unsigned size);
+    ~BufferRing();
+
+    BufferRing(const BufferRing &) = delete;
+    BufferRing &operator=(const BufferRing &) = delete;
+
+    uint16_t group() const
+    {return bgid;}
+
+    // 编号为 bid 的缓冲区
+    const char *data(uint16_t bid) const
+    {return buffers + static_cast<size_t>(bid) * buf_size;}
+
+    // 归还编号为 bid 的缓冲区
+    void recycle(uint16_t bid);
+
+private:
+    IOUring &ring;
+    uint16_t bgid;
+    unsigned entries;
+    unsigned buf_size;
+    io_uring_buf_ring *br = nullptr;
+    size_t br_size = 0;
+    char *buffers = nullptr;
+    uint16_t tail = 0;
+
+    void add(uint16_t bid);
+};
+
+inline IOUring::IOUring(unsigned entries, bool disabled)
+{
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SUBMIT_ALL | IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN;
+    if (disabled)
+        params.flags |= IORING_SETUP_R_DISABLED;
+    params.cq_entries = entries * 4;
+    ring_fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+    if (ring_fd < 0 && errno == EINVAL)
+    {
+        // 较旧的内核不支持 SINGLE_ISSUER、DEFER_TASKRUN
+        params.flags &= ~(IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN);
+        ring_fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+    }
+    if (ring_fd < 0)
+        throw std::runtime_error("io_uring_setup error: " + std::string(strerror(errno)));
+    features = params.features;
+    if (!(features & IORING_FEAT_EXT_ARG) || !(features & IORING_FEAT_NODROP))
+    {
+        close(ring_fd);
+        throw std::runtime_error("io_uring_setup error: kernel is too old");
+    }
+
+    sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    if (features & IORING_FEAT_SINGLE_MMAP)
+        sq_size = cq_size = std::max(sq_size, cq_size);
+    sq_ptr = mmap(nullptr, sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+    if (sq_ptr == MAP_FAILED)
+    {
+        close(ring_fd);
+        throw std::runtime_error("io_uring mmap error: " + std::string(strerror(errno)));
+    }
+    cq_ptr = sq_ptr;
+    if (!(features & IORING_FEAT_SINGLE_MMAP))
+    {
+        cq_ptr = mmap(nullptr, cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+        if (cq_ptr == MAP_FAILED)
+        {
+            munmap(sq_ptr, sq_size);
+            close(ring_fd);
+            throw std::runtime_error("io_uring mmap error: " + std::string(strerror(errno)));
+        }
+    }
+    sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    sqes = static_cast<io_uring_sqe *>(mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES));
+    if (sqes == MAP_FAILED)
+    {
+        if (cq_ptr != sq_ptr)
+            munmap(cq_ptr, cq_size);
+        munmap(sq_ptr, sq_size);
+        close(ring_fd);
+        throw std::runtime_error("io_uring mmap error: " + std::string(strerror(errno)));
+    }
+
+    char *sq = static_cast<char *>(sq_ptr);
+    sq_khead = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+    sq_ktail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    sq_mask = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    sq_entries = params.sq_entries;
+    sq_tail = *sq_ktail;
+    // sqe 与提交队列中的位置一一对应
+    unsigned *array = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+    for (unsigned i = 0; i < sq_entries; i++)
+        array[i] = i;
+
+    char *cq = static_cast<char *>(cq_ptr);
+    cq_khead = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    cq_ktail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    cq_mask = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+}
+
+inline IOUring::~IOUring()
+{
+    munmap(sqes, sqes_size);
+    if (cq_ptr != sq_ptr)
+        munmap(cq_ptr, cq_size);
+    munmap(sq_ptr, sq_size);
+    close(ring_fd);
+}
+
+inline void IOUring::enable()
+{
+    if (syscall(__NR_io_uring_register, ring_fd, IORING_REGISTER_ENABLE_RINGS, nullptr, 0) < 0)
+        throw std::runtime_error("io_uring enable error: " + std::string(strerror(errno)));
+}
+
+inline io_uring_sqe *IOUring::get_sqe()
+{
+    // 提交队列已满，先提交
+    if (sq_tail - __atomic_load_n(sq_khead, __ATOMIC_ACQUIRE) >= sq_entries)
+        submit();
+    if (sq_tail - __atomic_load_n(sq_khead, __ATOMIC_ACQUIRE) >= sq_entries)
+        return nullptr;
+    io_uring_sqe *sqe = &sqes[sq_tail & sq_mask];
+    std::memset(sqe, 0, sizeof(*sqe));
+    ++sq_tail;
+    ++pending;
+    return sqe;
+}
+
+inline int IOUring::submit()
+{
+    if (pending == 0)
+        return 0;
+    return enter(pending, 0, 0, nullptr, 0);
+}
+
+inline int IOUring::submit_and_wait(int timeout_ms)
+{
+    __kernel_timespec ts;
+    ts.tv_sec = timeout_ms / 1000;
+    ts.tv_nsec = static_cast<long long>(timeout_ms % 1000) * 1000000;
+    io_uring_getevents_arg arg;
+    std::memset(&arg, 0, sizeof(arg));
+    arg.sigmask_sz = _NSIG / 8;
+    arg.ts = reinterpret_cast<uint64_t>(&ts);
+    int ret = enter(pending, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+    if (ret < 0 && (errno == ETIME || errno == EINTR))
+        return 0;
+    return ret;
+}
+
+inline int IOUring::enter(unsigned to_submit, unsigned min_complete, unsigned flags, const void *arg, size_t argsz)
+{
+    __atomic_store_n(sq_ktail, sq_tail, __ATOMIC_RELEASE);
+    int ret = static_cast<int>(syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags, arg, argsz));
+    if (ret >= 0)
+        pending -= std::min<unsigned>(pending, ret);
+    return ret;
+}
+
+template <typename Func>
+unsigned IOUring::for_each_cqe(Func func)
+{
+    unsigned head = *cq_khead;
+    unsigned tail = __atomic_load_n(cq_ktail, __ATOMIC_ACQUIRE);
+    unsigned count = tail - head;
+    for (; head != tail; ++head)
+        func(cqes[head & cq_mask]);
+    __atomic_store_n(cq_khead, head, __ATOMIC_RELEASE);
+    return count;
+}
+
+inline void IOUring::prep(io_uring_sqe *sqe, uint8_t opcode, int fd, uint64_t addr, unsigned len)
+{
+    sqe->opcode = opcode;
+    sqe->fd = fd;
+    sqe->addr = addr;
+    sqe->len = len;
+}
+
+inline void IOUring::prep_accept_multishot(io_uring_sqe *sqe, int fd, int flags)
+{
+    prep(sqe, IORING_OP_ACCEPT, fd, 0, 0);
+    sqe->ioprio |= IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = flags;
+}
+
+inline void IOUring::prep_recv_multishot(io_uring_sqe *sqe, int fd, uint16_t buf_group)
+{
+    prep(sqe, IORING_OP_RECV, fd, 0, 0);
+    sqe->ioprio |= IORING_RECV_MULTISHOT;
+    sqe->flags |= IOSQE_BUFFER_SELECT;
+    sqe->buf_group = buf_group;
+}
+
+inline void IOUring::prep_sendmsg(io_uring_sqe *sqe, int fd, const msghdr *msg, int flags)
+{
+    prep(sqe, IORING_OP_SENDMSG, fd, reinterpret_cast<uint64_t>(msg), 1);
+    sqe->msg_flags = flags;
+}
+
+inline void IOUring::prep_read(io_uring_sqe *sqe, int fd, void *buf, unsigned len)
+{
+    prep(sqe, IORING_OP_READ, fd, reinterpret_cast<uint64_t>(buf), len);
+    sqe->off = static_cast<uint64_t>(-1); // 从当前位置读取
+}
+
+inline void IOUring::prep_cancel_all(io_uring_sqe *sqe)
+{
+    prep(sqe, IORING_OP_ASYNC_CANCEL, -1, 0, 0);
+    sqe->cancel_flags = IORING_ASYNC_CANCEL_ANY;
+}
+
+inline BufferRing::BufferRing(IOUring &ring, uint16_t group, unsigned count, unsigned size)
+    : ring(ring), bgid(group), entries(count), buf_size(size)
+{
+    if (count == 0 || (count & (count - 1)) != 0 || count > 32768)
+        throw std::runtime_error("BufferRing: count must be a power of 2 and no more than 32768");
+
+    br_size = count * sizeof(io_uring_buf);
+    void *mem = mmap(nullptr, br_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED)
+        throw std::runtime_error("BufferRing mmap error: " + std::string(strerror(errno)));
+    br = static_cast<io_uring_buf_ring *>(mem);
+
+    io_uring_buf_reg reg;
+    std::memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = reinterpret_cast<uint64_t>(br);
+    reg.ring_entries = count;
+    reg.bgid = group;
+    if (syscall(__NR_io_uring_register, ring.fd(), IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+    {
+        int err = errno;
+        munmap(br, br_size);
+        throw std::runtime_error("io_uring register buffer ring error: " + std::string(strerror(err)));
+    }
+
+    buffers = new char[static_cast<size_t>(count) * size];
+    for (unsigned i = 0; i < count; i++)
+        add(static_cast<uint16_t>(i));
+    __atomic_store_n(&br->tail, tail, __ATOMIC_RELEASE);
+}
+
+inline BufferRing::~BufferRing()
+{
+    io_uring_buf_reg reg;
+    std::memset(&reg, 0, sizeof(reg));
+    reg.bgid = bgid;
+    syscall(__NR_io_uring_register, ring.fd(), IORING_UNREGISTER_PBUF_RING, &reg, 1);
+    munmap(br, br_size);
+    delete[] buffers;
+}
+
+inline void BufferRing::recycle(uint16_t bid)
+{
+    add(bid);
+    __atomic_store_n(&br->tail, tail, __ATOMIC_RELEASE);
+}
+
+inline void BufferRing::add(uint16_t bid)
+{
+    // C++ 中 bufs 柔性数组的偏移与内核不一致，直接按 io_uring_buf 计算位置
+    io_uring_buf &buf = reinterpret_cast<io_uring_buf *>(br)[tail & (entries - 1)];
+    buf.addr = reinterpret_cast<uint64_t>(data(bid));
+    buf.len = buf_size;
+    buf.bid = bid;
+    ++tail;
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <random>
+#include <stdexcept>
+
+/**
+ * @brief sub reactor 之间的无锁负载均衡
+ *
+ * 每个 sub reactor 一组原子计数器：活跃连接数、进行中（排队或正在执行）的请求数，负载为两者之和，
+ * 少数连接非常繁忙时，进行中的请求数能反映真实的负载，而不只是连接数
+ * 新连接随机选择两个 sub reactor，交给负载较低的一个（power of two choices）：不需要加锁，计数器也不需要保持有序，
+ * 计数器的增减由各个 reactor、工作线程直接完成
+ *
+ */
+class LoadBalancer
+{
+public:
+    // 添加一个 sub reactor，返回它的下标；只在启动 reactor 之前调用
+    size_t add(int id);
+
+    size_t size() const
+    {return slots.size();}
+
+    // 第 i 个 sub reactor 的标识（epoll 实例或 io_uring 实例的 fd）
+    int id(size_t i) const
+    {return slots[i]->id;}
+
+    // 标识为 id 的 sub reactor 的下标，sub reactor 的数量很少，直接遍历
+    size_t index(int id) const;
+
+    // 为新连接选择一个 sub reactor，返回它的下标
+    size_t pick();
+
+    void connected(size_t i)
+    {slots[i]->connections.fetch_add(1, std::memory_order_relaxed);}
+
+    void disconnected(size_t i)
+    {slots[i]->connections.fetch_sub(1, std::memory_order_relaxed);}
+
+    // 请求交给工作线程时调用
+    void dispatched(size_t i)
+    {slots[i]->inflight.fetch_add(1, std::memory_order_relaxed);}
+
+    // 请求的响应完成（包括被丢弃的请求）时调用
+    void completed(size_t i)
+    {slots[i]->inflight.fetch_sub(1, std::memory_order_relaxed);}
+
+    int connections(size_t i) const
+    {return slots[i]->connections.load(std::memory_order_relaxed);}
+
+    int inflight(size_t i) const
+    {return slots[i]->inflight.load(std::memory_order_relaxed);}
+
+    int64_t load(size_t i) const
+    {return static_cast<int64_t>(connections(i)) + inflight(i);}
+
+private:
+    // 每个 sub reactor 的计数器独占缓存行，不同 reactor 的更新互不干扰
+    struct alignas(64) Slot
+    {
+        int id;
+        std::atomic<int> connections{0};
+        std::atomic<int> inflight{0};
+
+        explicit Slot(int id)
+            : id(id) {}
+    };
+
+    std::vector<std::unique_ptr<Slot>> slots;
+};
+
+inline size_t LoadBalancer::add(int id)
+{
+    slots.emplace_back(new Slot(id));
+    return slots.size() - 1;
+}
+
+inline size_t LoadBalancer::index(int id) const
+{
+    for (size_t i = 0; i < slots.size(); i++)
+    {
+        if (slots[i]->id == id)
+            return i;
+    }
+    throw std::runtime_error("LoadBalancer: no such reactor: " + std::to_string(id));
+}
+
+inline size_t LoadBalancer::pick()
+{
+    size_t n = slots.size();
+    if (n <= 1)
+        return 0;
+    // 每个线程各自的随机数生成器，不需要同步
+    static thread_local std::minstd_rand rng(std::random_device{}());
+    size_t a = rng() % n;
+    size_t b = (a + 1 + rng() % (n - 1)) % n; // 与 a 不同的另一个
+    return load(b) < load(a) ? b : a;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <typeinfo>
+
+/**
+ * @brief 进程内调用的入口，由 RPCFramework 实现
+ *
+ * 同一进程中的 RPCClient 通过它直接调用已注册的过程，不经过 socket 与帧的收发
+ * RPCClient 只依赖该接口，不需要包含 RPCFramework（以及 log4cplus）
+ *
+ */
+class LocalEndpoint
+{
+public:
+    /**
+     * @brief 过程的类型化调用入口，参数、返回值都不经过序列化
+     *
+     * signature 为 typeid(RetType<R>::type(std::decay_t<Args>...))，与注册时的类型不一致时不调用，返回 MISMATCH
+     * args 指向 std::tuple<std::decay_t<Args>...>，ret 指向 RetType<R>::type
+     * 否则返回 ReturnPacket 的状态码
+     */
+    using invoker_t = std::function<int(const std::type_info &signature, void *args, void *ret)>;
+
+    static constexpr int MISMATCH = -1;
+
+    virtual ~LocalEndpoint() = default;
+
+    // 过程的类型化调用入口，没有该过程（或者还没有 freeze）时返回 nullptr
+    virtual const invoker_t *findInvoker(const std::string &name) const = 0;
+
+    // 处理一个请求（不含帧头），写入完整的响应帧，与 RPCFramework::handleRequest 相同
+    virtual void handleLocal(const std::string &request, std::string &response) = 0;
+};
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <atomic>
+#include <utility>
+
+/**
+ * @brief 无锁的多生产者、单消费者队列（Vyukov MPSC）
+ *
+ * push 可以在任意线程中调用，只有一次原子交换，不会阻塞
+ * pop 只能在一个线程中调用（例如 reactor 线程）
+ * 生产者交换 head 之后、链接 next 之前，消费者可能暂时看不到该元素，之后的 pop 会取到，不会丢失
+ *
+ */
+template <typename T>
+class MPSCQueue
+{
+    struct Node
+    {
+        std::atomic<Node *> next{nullptr};
+        T value;
+
+        Node() = default;
+        explicit Node(T &&value) : value(std::move(value)) {}
+    };
+
+    std::atomic<Node *> head; // 生产者在 head 处追加
+    Node *tail;               // 消费者从 tail 处取出，tail 始终指向一个已经取出的节点（哨兵）
+
+public:
+    MPSCQueue()
+    {
+        Node *stub = new Node();
+        head.store(stub, std::memory_order_relaxed);
+        tail = stub;
+    }
+
+    ~MPSCQueue()
+    {
+        T value;
+        while (pop(value))
+            ;
+        delete tail;
+    }
+
+    MPSCQueue(const MPSCQueue &) = delete;
+    MPSCQueue &operator=(const MPSCQueue &) = delete;
+
+    void push(T value)
+    {
+        Node *node = new Node(std::move(value));
+        Node *prev = head.exchange(node, std::memory_order_acq_rel);
+        prev->next.store(node, std::memory_order_release);
+    }
+
+    // 队列为空时返回 false
+    bool pop(T &value)
+    {
+        Node *next = tail->next.load(std::memory_order_acquire);
+        if (next == nullptr)
+            return false;
+        value = std::move(next->value);
+        delete tail;
+        tail = next; // next 成为新的哨兵
+        return true;
+    }
+};
@@ -0,0 +1,152 @@
+#pragma once
+
+#include <deque>
+#include <string>
+#include <cerrno>
+#include <climits>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include "Buffer.hpp"
+
+/**
+ * @brief 每个连接的输出队列，本身不加锁：工作线程追加响应、reactor 写出，都在持有连接的 write_lock 时进行
+ *
+ * 队列中的每一项都是完整的帧（帧头与数据在同一个缓冲区中），通过 sendmsg 一次写出多个帧，不做拼接
+ * 记录队首帧已经写出的字节数，部分写入后，下次从断点继续
+ *
+ */
+class OutputQueue
+{
+public:
+    enum class Status
+    {
+        DONE,  // 队列已清空
+        AGAIN, // socket 发送缓冲区已满（EAGAIN），还有数据等待写出
+        ERROR  // 出错，例如对端已经关闭
+    };
+
+    static constexpr size_t MAX_IOV = 64; // 单次 sendmsg 最多聚合的帧数，不超过 IOV_MAX
+
+    // 写出的统计，由调用者累计
+    struct Stats
+    {
+        size_t calls = 0;  // sendmsg 的次数
+        size_t frames = 0; // 完整写出的帧数
+        size_t bytes = 0;  // 写出的字节数
+    };
+
+    void push(std::string &&frame)
+    {
+        bytes += frame.size();
+        frames.push_back(std::move(frame));
+    }
+
+    bool empty() const
+    {return frames.empty();}
+
+    // 队列中的帧数
+    size_t count() const
+    {return frames.size();}
+
+    // 还未写出的字节数
+    size_t pending() const
+    {return bytes - offset;}
+
+    /**
+     * @brief 写出队列中的数据，直到队列清空或 EAGAIN
+     *
+     * @param fd   非阻塞的 socket
+     * @param pool 写完的帧归还到 pool，为 nullptr 时直接释放
+     * @param stats 不为 nullptr 时，累计写出的统计
+     * @return Status
+     */
+    Status writeTo(int fd, BufferPool *pool = nullptr, Stats *stats = nullptr);
+
+    /**
+     * @brief 将队列中还未写出的数据填入 iov，不写 socket（例如交给 io_uring 发送）
+     *
+     * 在 consume 之前，iov 引用的帧一直有效；期间 push 新的帧不影响已经填入的部分
+     *
+     * @return 填入的项数，最多 max 项
+     */
+    size_t gather(iovec *iov, size_t max) const;
+
+    // 已经写出了 n 个字节，弹出完整写出的帧，最后一个部分写出的帧记录断点
+    void consume(size_t n, BufferPool *pool = nullptr, Stats *stats = nullptr);
+
+    // 丢弃所有未写出的数据
+    void clear(BufferPool *pool = nullptr);
+
+private:
+    std::deque<std::string> frames;
+    size_t offset = 0; // 队首帧已经写出的字节数
+    size_t bytes = 0;  // 队列中所有帧的总字节数（包括队首已写出的部分）
+
+    void pop(BufferPool *pool);
+};
+
+inline OutputQueue::Status OutputQueue::writeTo(int fd, BufferPool *pool, Stats *stats)
+{
+    iovec iov[MAX_IOV];
+    while (!frames.empty())
+    {
+        msghdr msg{};
+        msg.msg_iov = iov;
+        msg.msg_iovlen = gather(iov, MAX_IOV);
+        ssize_t n = sendmsg(fd, &msg, MSG_NOSIGNAL); // 对端关闭时返回 EPIPE，而不是产生 SIGPIPE
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return Status::AGAIN;
+            return Status::ERROR;
+        }
+        consume(n, pool, stats);
+    }
+    return Status::DONE;
+}
+
+inline size_t OutputQueue::gather(iovec *iov, size_t max) const
+{
+    size_t cnt = 0;
+    for (auto it = frames.begin(); it != frames.end() && cnt < max; ++it, ++cnt)
+    {
+        size_t skip = cnt == 0 ? offset : 0;
+        iov[cnt].iov_base = const_cast<char *>(it->data()) + skip;
+        iov[cnt].iov_len = it->size() - skip;
+    }
+    return cnt;
+}
+
+inline void OutputQueue::consume(size_t n, BufferPool *pool, Stats *stats)
+{
+    if (stats)
+    {
+        ++stats->calls;
+        stats->bytes += n;
+    }
+    while (!frames.empty() && n >= frames.front().size() - offset)
+    {
+        n -= frames.front().size() - offset;
+        pop(pool);
+        if (stats)
+            ++stats->frames;
+    }
+    offset += n;
+}
+
+inline void OutputQueue::clear(BufferPool *pool)
+{
+    while (!frames.empty())
+        pop(pool);
+}
+
+inline void OutputQueue::pop(BufferPool *pool)
+{
+    bytes -= frames.front().size();
+    if (pool)
+        pool->release(std::move(frames.front()));
+    frames.pop_front();
+    offset = 0;
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <string_view>
+#include <numeric>
+#include <algorithm>
+#include <stdexcept>
+#include <cstdint>
+
+/**
+ * @brief 最小完美哈希（hash and displace），将 n 个互不相同的字符串一一映射到 [0, n)
+ *
+ * 构建：先将 key 按第一次哈希分到 n 个桶中，再从大到小为每个桶寻找一个种子，
+ *      使桶内所有 key 经过第二次哈希后，都落在尚未被占用的槽位上
+ * 查找：两次哈希 + 一次比较，没有冲突链，也不会退化
+ *
+ */
+class PerfectHash
+{
+    std::vector<uint32_t> seeds; // 每个桶的种子
+    std::vector<std::string> keys; // keys[slot] 为映射到该槽位的 key，用于确认查找的 key 确实存在
+
+public:
+    static constexpr size_t NPOS = static_cast<size_t>(-1);
+    static constexpr uint32_t MAX_SEED = 1u << 24; // 单个桶尝试的种子数上限
+
+    PerfectHash() = default;
+
+    // 构建完美哈希，keys 中不能有重复的字符串
+    explicit PerfectHash(const std::vector<std::string> &keys);
+
+    // 返回 key 所在的槽位，key 不存在时返回 NPOS
+    size_t find(std::string_view key) const;
+
+    size_t size() const
+    {return keys.size();}
+
+    // 槽位 slot 对应的 key
+    const std::string &keyAt(size_t slot) const
+    {return keys.at(slot);}
+
+private:
+    // FNV-1a，使用 seed 扰动初始值
+    static uint64_t hash(std::string_view key, uint32_t seed);
+};
+
+inline PerfectHash::PerfectHash(const std::vector<std::string> &input)
+{
+    size_t n = input.size();
+    if (n == 0)
+        return;
+
+    // 第一次哈希，分桶
+    std::vector<std::vector<size_t>> buckets(n);
+    for (size_t i = 0; i < n; i++)
+        buckets[hash(input[i], 0) % n].push_back(i);
+
+    // 从大到小处理，越大的桶越难放置，应当优先处理
+    std::vector<size_t> order(n);
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b)
+    {
+        return buckets[a].size() > buckets[b].size();
+    });
+
+    seeds.assign(n, 0);
+    keys.assign(n, std::string());
+    std::vector<bool> used(n, false);
+    std::vector<size_t> slots;
+    for (size_t b : order)
+    {
+        if (buckets[b].empty())
+            break;
+
+        uint32_t seed = 1;
+        for (; seed < MAX_SEED; seed++)
+        {
+            slots.clear();
+            bool ok = true;
+            for (size_t i : buckets[b])
+            {
+                size_t slot = hash(input[i], seed) % n;
+                if (used[slot] || std::find(slots.begin(), slots.end(), slot) != slots.end())
+                {
+                    ok = false;
+                    break;
+                }
+                slots.push_back(slot);
+            }
+            if (ok)
+                break;
+        }
+        if (seed == MAX_SEED)
+            throw std::runtime_error("PerfectHash: can not build, duplicate keys?");
+
+        seeds[b] = seed;
+        for (size_t j = 0; j < slots.size(); j++)
+        {
+            used[slots[j]] = true;
+            keys[slots[j]] = input[buckets[b][j]];
+        }
+    }
+}
+
+inline size_t PerfectHash::find(std::string_view key) const
+{
+    size_t n = keys.size();
+    if (n == 0)
+        return NPOS;
+    size_t slot = hash(key, seeds[hash(key, 0) % n]) % n;
+    return keys[slot] == key ? slot : NPOS;
+}
+
+inline uint64_t PerfectHash::hash(std::string_view key, uint32_t seed)
+{
+    uint64_t h = 14695981039346656037ull ^ (seed * 0x9E3779B97F4A7C15ull);
+    for (unsigned char c : key)
+    {
+        h ^= c;
+        h *= 1099511628211ull;
+    }
+    // 混合高位，避免取模时只用到低位
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    return h;
+}
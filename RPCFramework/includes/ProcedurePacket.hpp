@@ -4,6 +4,7 @@
 #include <memory>
 #include <tuple>
 #include <utility>
+#include <stdexcept>
 #include "Serializable.hpp"
 
 
@@ -45,21 +46,76 @@ expand_tuple(std::istream& is, std::tuple<X...>&t)
     expand_tuple<Index + 1, X...>(is, t);
 }
 
+// 请求头，服务端只解析一次，然后从同一位置继续解析参数
+// 格式：[ 请求编号（定长 4 字节）][ 编码方式（1 字节）][ 超时时间（定长 4 字节，可选）][ 过程的编号 ]
+struct RequestHeader : public Serializable
+{
+    uint32_t seq = 0; // 请求编号，由客户端分配，服务端原样写入响应头，用于在同一连接上同时发出多个请求
+    uint32_t id = 0; // 过程的编号，由服务端在启动时分配，客户端通过 LOOKUP_ID 查询
+    Codec codec = Serializable::DEFAULT_CODEC; // 请求使用的编码方式，服务端使用相同的方式编码响应
+    uint32_t timeout = NO_TIMEOUT; // 客户端剩余的等待时间（微秒），服务端从收到请求时开始计算期限
+
+    // 内置的查询过程的编号，参数为过程的名称（std::string），返回过程的编号（uint32_t）
+    static constexpr uint32_t LOOKUP_ID = 0;
+
+    static constexpr uint32_t NO_TIMEOUT = 0;
+    // 编码方式的标识都是 ASCII 字符，最高位置位表示之后带有超时时间，没有期限的请求不增加长度
+    static constexpr unsigned char TIMEOUT_FLAG = 0x80;
+
+    RequestHeader() = default;
+
+    RequestHeader(uint32_t id)
+        :id(id) {}
+
+    static std::ostream& Serialize(std::ostream &os, const RequestHeader &header)
+    {
+        // 请求编号定长，即使后面的部分无法解析，服务端也能将错误响应发给对应的请求
+        Serializable::writeRaw(os, header.seq);
+        // 之后 1 字节标识编码方式，服务端据此解码请求
+        char tag = static_cast<char>(Serializable::getCodec(os));
+        if (header.timeout == NO_TIMEOUT)
+            os.put(tag);
+        else
+        {
+            os.put(static_cast<char>(tag | TIMEOUT_FLAG));
+            Serializable::writeRaw(os, header.timeout);
+        }
+        Serializable::Serialize(os, header.id);
+        return os;
+    }
+
+    // 解析完成后，is 的编码方式被设置为请求的编码方式
+    static std::istream& DeSerialize(std::istream &is, RequestHeader &header)
+    {
+        Serializable::readRaw(is, header.seq);
+        char tag = is.get();
+        bool timed = tag & TIMEOUT_FLAG;
+        tag &= ~TIMEOUT_FLAG;
+        if (!Serializable::vaildCodec(tag))
+            throw std::runtime_error("RequestHeader: unknown codec tag");
+        header.codec = static_cast<Codec>(tag);
+        if (timed)
+            Serializable::readRaw(is, header.timeout);
+        Serializable::setCodec(is, header.codec);
+        Serializable::DeSerialize(is, header.id);
+        return is;
+    }
+};
+
 template <typename ...Args>
-struct ProcedurePacket : public Serializable
+struct ProcedurePacket : public RequestHeader
 {
-    std::string name; // 过程的名称
     std::tuple<Args ...> t; // tuple 用于保存传递的参数
 
     ProcedurePacket() = default; // 缺陷：Args 不能包含引用类型的参数
 
-    ProcedurePacket(const std::string &name, Args... args)
-        :name(name), t(std::make_tuple(args...)) {}
+    ProcedurePacket(uint32_t id, Args... args)
+        :RequestHeader(id), t(std::make_tuple(args...)) {}
 
     template <typename ...X>
     static std::ostream& Serialize(std::ostream &os, const ProcedurePacket<X ...> &packet)
     {
-        os << packet.name << " ";
+        RequestHeader::Serialize(os, packet);
         expand_tuple(os, packet.t);
         return os;
     }
@@ -67,7 +123,7 @@ struct ProcedurePacket : public Serializable
     template <typename ...X>
     static std::istream& DeSerialize(std::istream &is, ProcedurePacket<X ...> &packet)
     {
-        is >> packet.name;
+        RequestHeader::DeSerialize(is, packet);
         expand_tuple(is, packet.t);
         return is;
     }
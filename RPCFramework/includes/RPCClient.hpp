@@ -1,25 +1,120 @@
 #pragma once
 
 #include <iostream>
+#include <unordered_map>
+#include <unordered_set>
 #include "TCPSocket.hpp"
+#include "SharedMemory.hpp"
+#include "LocalEndpoint.hpp"
+#include "RPCContext.hpp"
+#include <deque>
+#include <fcntl.h>
 #include "Serializer.hpp"
 #include "ProcedurePacket.hpp"
 #include "ReturnPacket.hpp"
+#include "Frame.hpp"
+
+class RPCClient;
+
+/**
+ * @brief 异步调用的结果，由 RPCClient::asyncRemoteCall 返回
+ *
+ * get 时才从连接中读取响应，期间收到的其它请求的响应会先缓存在 RPCClient 中
+ * 只能移动，不能拷贝；不再需要结果时直接析构即可，之后收到的响应会被丢弃
+ *
+ */
+template <typename R>
+class RPCFuture
+{
+    RPCClient *client;
+    uint32_t seq;
+    RPCContext::clock::time_point deadline; // 发出请求时确定的期限，get 最多等到此时
+
+public:
+    RPCFuture(RPCClient *client, uint32_t seq, RPCContext::clock::time_point deadline = RPCContext::NO_DEADLINE)
+        : client(client), seq(seq), deadline(deadline) {}
+
+    RPCFuture(RPCFuture &&other) noexcept
+        : client(other.client), seq(other.seq), deadline(other.deadline)
+    {
+        other.client = nullptr;
+    }
+
+    RPCFuture(const RPCFuture &) = delete;
+    RPCFuture &operator=(const RPCFuture &) = delete;
+
+    ~RPCFuture();
+
+    // 等待并返回调用的结果，服务端返回错误码、或者超过期限时抛出异常，只能调用一次
+    R get();
+};
 
 class RPCClient
 {
     TCPSocket *clnt;
+    std::unique_ptr<ShmChannel> shm; // 共享内存连接，此时 clnt 为 nullptr
+    LocalEndpoint *local = nullptr;  // 进程内调用，此时 clnt 为 nullptr
+    std::unordered_map<std::string, const LocalEndpoint::invoker_t *> invokers; // 过程名称 -> 类型化调用入口，每个过程只查找一次
+    std::string localRequest;        // 进程内调用退回到序列化时，去掉帧头的请求
+    std::deque<std::string> localResponses; // 进程内调用退回到序列化时，已经产生、还未读取的响应帧
+    FrameDecoder input;              // socket 为非阻塞的，收到的数据先交给 decoder，超时时不完整的帧留到下一次接收
     bool closed;
+    Codec codec; // 该连接使用的编码方式
+    std::chrono::milliseconds timeout{0}; // 默认的超时时间，为 0 时不限制
+    std::unordered_map<std::string, uint32_t> methodIds; // 过程名称 -> 编号，每个连接只查询一次
+    std::string sendBuf, recvBuf; // 收发缓冲区，每次调用重复使用
+    uint32_t nextSeq = 0; // 下一个请求的编号
+    std::unordered_map<uint32_t, std::string> arrived; // 已经收到、但还没有被取走的响应（不含响应头）
+    std::unordered_set<uint32_t> abandoned; // 结果已经不再需要的请求
+
+    template <typename R>
+    friend class RPCFuture;
+
 public:
-    RPCClient(const std::string &ip, uint16_t port)
-        : clnt(new TCPSocket()), closed(false)
+    RPCClient(const std::string &ip, uint16_t port, Codec codec = Serializable::DEFAULT_CODEC)
+        : clnt(new TCPSocket()), closed(false), codec(codec)
     {
         clnt->connect(ip, port);
+        setNonBlocking();
+    }
+
+    // endpoint 为 "unix:/path"、"shm:/path"（同一主机上的服务端，path 为 RPCServerOptions::shm_path）或 "ip:port"
+    explicit RPCClient(const std::string &endpoint, Codec codec = Serializable::DEFAULT_CODEC)
+        : clnt(nullptr), closed(false), codec(codec)
+    {
+        if (endpoint.compare(0, 4, "shm:") == 0)
+        {
+            shm.reset(new ShmChannel(endpoint.substr(4)));
+            return;
+        }
+        clnt = new TCPSocket();
+        std::string path;
+        if (parse_unix_endpoint(endpoint, path))
+        {
+            clnt->connect(endpoint, 0);
+            setNonBlocking();
+            return;
+        }
+        size_t colon = endpoint.rfind(':');
+        if (colon == std::string::npos)
+            throw std::runtime_error("Illegal endpoint: " + endpoint);
+        clnt->connect(endpoint.substr(0, colon), static_cast<uint16_t>(std::stoi(endpoint.substr(colon + 1))));
+        setNonBlocking();
     }
 
+    /**
+     * @brief 进程内调用：remoteCall 直接调用 endpoint 中注册的过程，不经过 socket
+     * 
+     * 参数、返回值的类型与注册时完全一致时（decay 之后），参数按值复制一次后直接调用，不经过序列化；
+     * 否则（例如传入 const char * 而过程的参数为 std::string）、以及 asyncRemoteCall，仍然经过编码，但不经过 socket
+     * endpoint 需要已经 freeze（RPCServer::start 时，或者直接调用 RPCFramework::freeze），且比 RPCClient 存活更久
+     */
+    explicit RPCClient(LocalEndpoint &endpoint, Codec codec = Serializable::DEFAULT_CODEC)
+        : clnt(nullptr), local(&endpoint), closed(false), codec(codec) {}
+
     ~RPCClient()
     {
-        if(!closed)
+        if(!closed && clnt)
         {
             clnt->close();
             delete clnt;
@@ -36,21 +131,237 @@ public:
     typename
     std::enable_if<std::is_same<R, void>::value, void>::type
     remoteCall(const std::string &procedureName, const Args& ...args);
+
+    /**
+     * @brief 最多等待 timeout，超时时抛出异常，之后收到的响应会被丢弃
+     *
+     * 剩余的等待时间随请求发给服务端，工作线程取出请求时已经超时的，不再调用过程；
+     * 过程执行期间可以通过 RPCContext::current() 查询剩余的时间
+     */
+    template <typename R, typename ...Args>
+    typename
+    std::enable_if<!std::is_same<R, void>::value, R>::type
+    remoteCall(std::chrono::milliseconds timeout, const std::string &procedureName, const Args& ...args);
+
+    template <typename R, typename ...Args>
+    typename
+    std::enable_if<std::is_same<R, void>::value, void>::type
+    remoteCall(std::chrono::milliseconds timeout, const std::string &procedureName, const Args& ...args);
+
+    // 没有指定超时时间的调用（包括 asyncRemoteCall）使用的超时时间，为 0 时不限制
+    void setTimeout(std::chrono::milliseconds t)
+    {timeout = t;}
+
+    /**
+     * @brief 发出请求后立即返回，不等待响应
+     * 
+     * 同一连接上可以连续发出多个请求（pipelining），服务端并发执行，响应按完成的顺序返回，通过请求编号对应
+     * 同一个 RPCClient 不是线程安全的，RPCFuture 也需要在发出请求的线程中 get
+     */
+    template <typename R, typename ...Args>
+    RPCFuture<R> asyncRemoteCall(const std::string &procedureName, const Args& ...args);
+
+private:
+    // 获取过程的编号，第一次调用时向服务端查询，之后使用缓存
+    uint32_t resolve(const std::string &procedureName, RPCContext::clock::time_point deadline);
+
+    // 调用的期限：t 为 0 时使用 setTimeout 设置的超时时间；在过程中发起调用时，不会晚于当前请求的期限
+    RPCContext::clock::time_point deadlineFor(std::chrono::milliseconds t) const;
+
+    // 发送请求，返回请求的编号；剩余的等待时间写入请求头，服务端据此放弃客户端已经不再等待的请求
+    template <typename ...Args>
+    uint32_t send(uint32_t id, RPCContext::clock::time_point deadline, const Args& ...args);
+
+    // 等待编号为 seq 的响应，并解析；超过 deadline 时放弃该请求，抛出异常
+    template <typename R>
+    ReturnPacket<R> wait(uint32_t seq, RPCContext::clock::time_point deadline = RPCContext::NO_DEADLINE);
+
+    // 编号为 seq 的请求不再需要结果
+    void abandon(uint32_t seq);
+
+    // 进程内调用的类型化版本，结果写入 ret；类型与注册时不一致、或者没有该过程时返回 false，由调用者退回到序列化的方式
+    template <typename R, typename ...Args>
+    bool callLocal(const std::string &procedureName, RPCContext::clock::time_point deadline, typename RetType<R>::type &ret, const Args& ...args);
+
+    // 发送已经包含帧头的请求，经过 socket 或共享内存，最多等到 deadline；进程内调用时直接处理，响应留到 receive 时读取
+    void transmit(const std::string &frame, RPCContext::clock::time_point deadline);
+
+    // 接收下一个响应帧的数据部分，最多等到 deadline，超时返回 false
+    bool receive(std::string &buffer, RPCContext::clock::time_point deadline);
+
+    // 连接 socket 设为非阻塞，接收时通过 poll 等待，才能在超时时返回
+    void setNonBlocking()
+    {fcntl(clnt->native_sock(), F_SETFL, fcntl(clnt->native_sock(), F_GETFL) | O_NONBLOCK);}
 };
 
+inline uint32_t RPCClient::resolve(const std::string &procedureName, RPCContext::clock::time_point deadline)
+{
+    auto it = methodIds.find(procedureName);
+    if (it != methodIds.end())
+        return it->second;
+
+    ReturnPacket<uint32_t> ret = wait<uint32_t>(send(RequestHeader::LOOKUP_ID, deadline, procedureName), deadline);
+    if(!ret.vaild())
+        throw std::runtime_error("remoteCall: Received error code from server, error code: " + std::to_string(ret.getCode()));
+    methodIds[procedureName] = ret.getRet();
+    return ret.getRet();
+}
+
+inline RPCContext::clock::time_point RPCClient::deadlineFor(std::chrono::milliseconds t) const
+{
+    auto deadline = RPCContext::currentDeadline();
+    if (t.count() == 0)
+        t = timeout;
+    if (t.count() > 0)
+        deadline = std::min(deadline, RPCContext::clock::now() + t);
+    return deadline;
+}
+
+template <typename ...Args>
+uint32_t RPCClient::send(uint32_t id, RPCContext::clock::time_point deadline, const Args& ...args)
+{
+    ProcedurePacket<Args ...> packet(id, args...);
+    if (deadline != RPCContext::NO_DEADLINE)
+    {
+        auto remaining = std::chrono::ceil<std::chrono::microseconds>(deadline - RPCContext::clock::now()).count();
+        if (remaining <= 0)
+            throw std::runtime_error("remoteCall: timeout");
+        // 超出 4 字节范围（约 71 分钟）的期限只在客户端检查
+        if (remaining < UINT32_MAX)
+            packet.timeout = static_cast<uint32_t>(remaining);
+    }
+    packet.seq = nextSeq++;
+    // 直接在 sendBuf 中编码帧头与请求
+    Frame::reserve(sendBuf);
+    Serializer::Serialize(packet, sendBuf, codec);
+    Frame::finish(sendBuf);
+    transmit(sendBuf, deadline);
+    return packet.seq;
+}
+
+template <typename R>
+ReturnPacket<R> RPCClient::wait(uint32_t seq, RPCContext::clock::time_point deadline)
+{
+    auto it = arrived.find(seq);
+    if (it != arrived.end())
+    {
+        ReturnPacket<R> ret = Serializer::Deserialize<ReturnPacket<R>>(it->second, codec);
+        arrived.erase(it);
+        return ret;
+    }
+
+    while (true)
+    {
+        if (!receive(recvBuf, deadline))
+        {
+            abandon(seq);
+            throw std::runtime_error("remoteCall: timeout");
+        }
+        if (recvBuf.size() < ResponseHeader::SIZE)
+            throw std::runtime_error("remoteCall: malformed response");
+        uint32_t got = ResponseHeader::read(recvBuf.data());
+        if (got == seq)
+            return Serializer::Deserialize<ReturnPacket<R>>(recvBuf.data() + ResponseHeader::SIZE, recvBuf.size() - ResponseHeader::SIZE, codec);
+        // 其它请求的响应，先缓存起来
+        if (abandoned.erase(got) == 0)
+            arrived[got].assign(recvBuf, ResponseHeader::SIZE, std::string::npos);
+    }
+}
+
+template <typename R, typename ...Args>
+bool RPCClient::callLocal(const std::string &procedureName, RPCContext::clock::time_point deadline, typename RetType<R>::type &ret, const Args& ...args)
+{
+    auto it = invokers.find(procedureName);
+    if (it == invokers.end())
+        it = invokers.emplace(procedureName, local->findInvoker(procedureName)).first;
+    if (it->second == nullptr)
+        return false;
+    if (deadline <= RPCContext::clock::now())
+        throw std::runtime_error("remoteCall: timeout");
+
+    // 参数按值复制，与远程调用的语义相同：过程修改参数不会影响调用者
+    std::tuple<std::decay_t<Args>...> tuple(args...);
+    RPCContext context(deadline); // 在当前线程中直接调用，过程同样可以查询期限
+    RPCContext::Scope scope(context);
+    int code = (*it->second)(typeid(typename RetType<R>::type(std::decay_t<Args>...)), &tuple, &ret);
+    if (code == LocalEndpoint::MISMATCH)
+        return false;
+    if (code != ReturnPacket<R>::SUCCESS)
+        throw std::runtime_error("remoteCall: Received error code from server, error code: " + std::to_string(code));
+    return true;
+}
+
+inline void RPCClient::transmit(const std::string &frame, RPCContext::clock::time_point deadline)
+{
+    if (shm || !local)
+    {
+        // 超时时帧已经写出一部分的，socket 已经关闭，之后的调用都会失败
+        bool sent = shm ? shm->sendFrame(frame, deadline) : clnt->sendFrame(frame, deadline);
+        if (!sent)
+            throw std::runtime_error("remoteCall: timeout");
+        return;
+    }
+    localRequest.assign(frame, Frame::HEADER_SIZE, std::string::npos);
+    localResponses.emplace_back();
+    local->handleLocal(localRequest, localResponses.back());
+}
+
+inline bool RPCClient::receive(std::string &buffer, RPCContext::clock::time_point deadline)
+{
+    if (shm)
+        return shm->receive(buffer, deadline);
+    if (local)
+    {
+        // 进程内调用在发送时已经同步完成，响应总是已经就绪
+        if (localResponses.empty())
+            throw std::runtime_error("recv error: no pending request");
+        buffer.assign(localResponses.front(), Frame::HEADER_SIZE, std::string::npos);
+        localResponses.pop_front();
+        return true;
+    }
+
+    if (clnt->isClosed())
+        throw std::runtime_error("recv error: connection closed");
+    bool eof = false;
+    while (!input.next(buffer))
+    {
+        if (input.failed())
+            throw std::runtime_error("recv error: frame too large");
+        if (eof)
+            throw std::runtime_error("recv error: connection closed");
+        pollfd pfd{clnt->native_sock(), POLLIN, 0};
+        int n = poll(&pfd, 1, poll_timeout(deadline));
+        if (n < 0 && errno != EINTR)
+            throw std::runtime_error("poll error: " + std::string(strerror(errno)));
+        if (n == 0)
+            return false;
+        FrameDecoder::Status status = input.readFrom(clnt->native_sock());
+        if (status == FrameDecoder::Status::ERROR && !input.failed())
+            throw std::runtime_error("recv error: " + std::string(strerror(errno)));
+        eof = status == FrameDecoder::Status::CLOSED; // 先取出已经收到的帧
+    }
+    return true;
+}
+
+inline void RPCClient::abandon(uint32_t seq)
+{
+    if (arrived.erase(seq) == 0)
+        abandoned.insert(seq);
+}
+
+template <typename R, typename ...Args>
+RPCFuture<R> RPCClient::asyncRemoteCall(const std::string &procedureName, const Args& ...args)
+{
+    auto deadline = deadlineFor(std::chrono::milliseconds(0));
+    return RPCFuture<R>(this, send(resolve(procedureName, deadline), deadline, args...), deadline);
+}
+
 template <typename R, typename ...Args>
 typename
 std::enable_if<!std::is_same<R, void>::value, R>::type
 RPCClient::remoteCall(const std::string &procedureName, const Args& ...args)
 {
-    ProcedurePacket<Args ...> packet(procedureName, args...);
-    std::string req = Serializer::Serialize(packet);
-    clnt->send(req);
-    std::string res = clnt->receive();
-    ReturnPacket<R> ret = Serializer::Deserialize<ReturnPacket<R>>(res);
-    if(!ret.vaild())
-        throw std::runtime_error("remoteCall: Received error code from server, error code: " + std::to_string(ret.getCode()));
-    return ret.getRet();
+    return remoteCall<R>(std::chrono::milliseconds(0), procedureName, args...);
 }
 
 template <typename R, typename ...Args>
@@ -59,4 +370,48 @@ std::enable_if<std::is_same<R, void>::value, void>::type
 RPCClient::remoteCall(const std::string &procedureName, const Args& ...args)
 {
     remoteCall<int>(procedureName, args...);
-}
\ No newline at end of file
+}
+
+template <typename R, typename ...Args>
+typename
+std::enable_if<!std::is_same<R, void>::value, R>::type
+RPCClient::remoteCall(std::chrono::milliseconds timeout, const std::string &procedureName, const Args& ...args)
+{
+    auto deadline = deadlineFor(timeout);
+    if (local)
+    {
+        typename RetType<R>::type ret{};
+        if (callLocal<R>(procedureName, deadline, ret, args...))
+            return ret;
+    }
+    return RPCFuture<R>(this, send(resolve(procedureName, deadline), deadline, args...), deadline).get();
+}
+
+template <typename R, typename ...Args>
+typename
+std::enable_if<std::is_same<R, void>::value, void>::type
+RPCClient::remoteCall(std::chrono::milliseconds timeout, const std::string &procedureName, const Args& ...args)
+{
+    remoteCall<int>(timeout, procedureName, args...);
+}
+
+template <typename R>
+RPCFuture<R>::~RPCFuture()
+{
+    if (client)
+        client->abandon(seq);
+}
+
+template <typename R>
+R RPCFuture<R>::get()
+{
+    if (!client)
+        throw std::runtime_error("RPCFuture: no result");
+    RPCClient *c = client;
+    client = nullptr;
+    ReturnPacket<R> ret = c->wait<R>(seq, deadline);
+    if(!ret.vaild())
+        throw std::runtime_error("remoteCall: Received error code from server, error code: " + std::to_string(ret.getCode()));
+    if constexpr (!std::is_void<R>::value)
+        return ret.getRet();
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <chrono>
+
+/**
+ * @brief 正在处理的请求的上下文，过程在执行期间通过 RPCContext::current() 得到
+ *
+ * 客户端在请求头中带上剩余的等待时间，服务端从收到请求时开始计算期限（与 request_timeout 取较早的一个），
+ * 工作线程取出请求时已经超过期限的，不再调用过程；过程执行期间可以查询剩余时间，提前放弃已经没有意义的工作
+ * 过程中再通过 RPCClient 发起调用时，没有指定超时时间的调用会沿用当前请求的期限
+ *
+ */
+class RPCContext
+{
+public:
+    using clock = std::chrono::steady_clock;
+
+    static constexpr clock::time_point NO_DEADLINE = clock::time_point::max();
+
+    explicit RPCContext(clock::time_point deadline = NO_DEADLINE)
+        : until(deadline) {}
+
+    // 当前线程正在处理的请求的上下文，不在过程中时返回 nullptr
+    static const RPCContext *current()
+    {return active();}
+
+    // 当前请求的期限，不在过程中、或者没有期限时为 NO_DEADLINE
+    static clock::time_point currentDeadline()
+    {return active() ? active()->until : NO_DEADLINE;}
+
+    clock::time_point deadline() const
+    {return until;}
+
+    bool hasDeadline() const
+    {return until != NO_DEADLINE;}
+
+    // 剩余的时间，没有期限时为 clock::duration::max()，已经超时为 0
+    clock::duration remaining() const;
+
+    bool expired() const
+    {return hasDeadline() && clock::now() >= until;}
+
+    /**
+     * @brief 在作用域内将 ctx 设为当前线程的上下文，离开时恢复之前的上下文
+     *
+     * 过程中可能再发起进程内调用，因此上下文可以嵌套
+     */
+    class Scope
+    {
+        const RPCContext *saved;
+
+    public:
+        explicit Scope(const RPCContext &ctx)
+            : saved(active())
+        {active() = &ctx;}
+
+        ~Scope()
+        {active() = saved;}
+
+        Scope(const Scope &) = delete;
+        Scope &operator=(const Scope &) = delete;
+    };
+
+private:
+    clock::time_point until;
+
+    static const RPCContext *&active()
+    {
+        static thread_local const RPCContext *ctx = nullptr;
+        return ctx;
+    }
+};
+
+inline RPCContext::clock::duration RPCContext::remaining() const
+{
+    if (!hasDeadline())
+        return clock::duration::max();
+    auto now = clock::now();
+    return now >= until ? clock::duration::zero() : until - now;
+}
@@ -3,6 +3,7 @@
 #include <unordered_map>
 #include <functional>
 #include <string>
+#include <atomic>
 #include <log4cplus/logger.h>
 #include <log4cplus/configurator.h>
 #include <log4cplus/loggingmacros.h>
@@ -10,6 +11,11 @@
 #include "ProcedurePacket.hpp"
 #include "ReturnPacket.hpp"
 #include "ThreadPool.h"
+#include "PerfectHash.hpp"
+#include "Buffer.hpp"
+#include "Frame.hpp"
+#include "LocalEndpoint.hpp"
+#include "RPCContext.hpp"
 
 template <typename Function, typename Tuple, size_t... Index>
 decltype(auto) apply_tuple_impl(Function&& func, Tuple&& tuple, std::index_sequence<Index...>) {
@@ -42,14 +48,22 @@ invoke(Function &&f, Tuple &&tuple)
     return 0;
 }
 
-class RPCFramework
+class RPCFramework : public LocalEndpoint
 {
 public: 
     static constexpr int DEFAULT_CRITICAL_TIME = 3000; // 默认调用过程临界时间，单位为 ms
 private:
-    std::unordered_map<std::string, std::function<std::string(const std::string&)>> procedures;
+    using procedure_t = std::function<void(std::istream&, std::string&)>; // 参数为已经解析完请求头的流，以及写入响应帧的缓冲区
+
+    std::unordered_map<std::string, procedure_t> procedures; // 注册阶段使用，freeze 之后清空
+    std::vector<procedure_t> methods;   // freeze 之后，以过程的编号为下标，methods[LOOKUP_ID] 为内置的查询过程
+    std::unordered_map<std::string, invoker_t> localProcedures; // 注册阶段使用，freeze 之后清空
+    std::vector<invoker_t> invokers;    // freeze 之后，以过程的编号为下标，进程内的类型化调用入口
+    PerfectHash nameIndex;              // 过程名称 -> 槽位，过程的编号为槽位 + 1
+    bool frozen = false;
     log4cplus::Logger logger;
     int criticalTime; // 若调用某个过程超过该时间，将会输出警告信息到日志文件中，-1 代表关闭警告
+    std::atomic<uint64_t> expired{0}; // 因超过期限而没有调用过程的请求数
     
 public:
     RPCFramework(int criticalTime = DEFAULT_CRITICAL_TIME)
@@ -76,135 +90,387 @@ public:
     template <typename Obj, typename Func>
     void registerProcedure(const std::string &name, Obj &obj, Func procedure);
 
-    // 处理用户的远程调用，并将返回结果序列化后，返回给用户
+    // 冻结注册表，为每个过程分配编号，之后不能再注册新的过程，RPCServer::start 时调用
+    void freeze();
+
+    // 处理用户的远程调用，返回完整的响应帧（包括帧头与响应头），可以直接发送给用户
     template <typename ...Args>
     std::string handleRequest(const std::string &request);
 
+    // 同上，响应帧写入 response（覆盖原有内容），response 可以重复使用，避免每次分配内存
+    template <typename ...Args>
+    void handleRequest(const std::string &request, std::string &response);
+
+    /**
+     * @brief 同上，并检查请求的期限
+     *
+     * @param arrival  收到请求的时间，请求头中的超时时间从它开始计算，为默认值时取当前时间
+     * @param deadline 服务端限定的期限，与请求头中的期限取较早的一个
+     * 已经超过期限的请求不再调用过程，直接回复 DEADLINE_EXCEEDED；过程执行期间可以通过 RPCContext::current() 查询期限
+     */
+    void handleRequest(const std::string &request, std::string &response,
+                       RPCContext::clock::time_point arrival, RPCContext::clock::time_point deadline = RPCContext::NO_DEADLINE);
+
+    // 因超过期限而没有调用过程的请求数
+    uint64_t expiredRequests() const
+    {return expired.load(std::memory_order_relaxed);}
+
+    // 不调用过程，直接以错误码 code 回复该请求（例如请求在队列中已经超时），响应帧写入 response
+    void rejectRequest(const std::string &request, std::string &response, ReturnPacket<void>::code_t code);
+
+    const invoker_t *findInvoker(const std::string &name) const override;
+
+    void handleLocal(const std::string &request, std::string &response) override
+    {handleRequest(request, response);}
+
 private:
+    // 解析请求头，并调用对应的过程
+    void dispatch(std::istream &is, std::string &response, RPCContext::clock::time_point arrival, RPCContext::clock::time_point deadline);
+
+    // 将 retPack 编码为一个完整的响应帧，写入 response，只写入一次，帧头最后回填
+    template <typename R>
+    static void makeResponse(const ReturnPacket<R> &retPack, Codec codec, std::string &response);
+
+    // 内置的查询过程，根据过程的名称返回编号
+    void lookupProcedure(std::istream &is, std::string &response);
+
+    // 过程的名称，用于日志
+    std::string nameOf(uint32_t id) const;
 
     /**
      * @brief 
      * 
      * @tparam Func 
      * @param f 待调用过程
-     * @param req 用户发出的请求
-     * @return std::string 
+     * @param is 用户发出的请求，已经解析完请求头，接下来是参数
+     * @param response 写入响应帧的缓冲区
      */
     template <typename Func>
-    std::string callProxy(Func f, const std::string &req);
+    void callProxy(const Func &f, std::istream &is, std::string &response);
 
     // 调用类的成员函数
     template <typename Obj, typename Func>
-    std::string callProxy(Obj &obj, Func f, const std::string &req);
+    void callProxy(Obj &obj, const Func &f, std::istream &is, std::string &response);
 
     // 调用帮助函数，支持 std::function
     template <typename R, typename ...Args>
-    std::string callProxyHelper(std::function<R(Args ...)> f, const std::string &req);
+    void callProxyHelper(const std::function<R(Args ...)> &f, std::istream &is, std::string &response);
 
     // 调用帮助函数，支持普通函数
     template <typename R, typename ...Args>
-    std::string callProxyHelper(R(*f)(Args ...), const std::string &req);   
+    void callProxyHelper(R(*f)(Args ...), std::istream &is, std::string &response);   
 
     // 调用帮助函数，支持类的成员函数
     template <typename R, typename Obj, typename ...Args>
-    std::string callProxyHelper(Obj &obj, R(Obj::*f)(Args...), const std::string &req);
+    void callProxyHelper(Obj &obj, R(Obj::*f)(Args...), std::istream &is, std::string &response);
+
+    // 从 is 的当前位置解析参数，调用 f，并序列化返回结果
+    template <typename R, typename ...Args, typename Function>
+    void callWithArgs(Function &&f, std::istream &is, std::string &response);
+
+    // 生成过程的类型化调用入口，与 callProxyHelper 一一对应
+    template <typename R, typename ...Args>
+    invoker_t makeInvoker(const std::string &name, const std::function<R(Args ...)> &f);
+
+    template <typename R, typename ...Args>
+    invoker_t makeInvoker(const std::string &name, R(*f)(Args ...));
+
+    template <typename R, typename Obj, typename ...Args>
+    invoker_t makeInvoker(const std::string &name, Obj &obj, R(Obj::*f)(Args...));
+
+    // 检查类型后调用 f，参数、返回值直接在 args、ret 之间传递
+    template <typename R, typename ...Args, typename Function>
+    invoker_t makeTypedInvoker(const std::string &name, Function f);
 };
 
 template <typename ...Args>
 std::string RPCFramework::handleRequest(const std::string &request)
 {
-    // 反序列化
-    ProcedurePacket<Args...> packet = Serializer::Deserialize<ProcedurePacket<Args...>>(request);
-    std::string name = packet.name;
-    if(!procedures.count(name))
+    std::string response;
+    handleRequest(request, response);
+    return response;
+}
+
+template <typename ...Args>
+void RPCFramework::handleRequest(const std::string &request, std::string &response)
+{
+    handleRequest(request, response, RPCContext::clock::time_point());
+}
+
+inline void RPCFramework::handleRequest(const std::string &request, std::string &response,
+                                        RPCContext::clock::time_point arrival, RPCContext::clock::time_point deadline)
+{
+    // 请求头与参数都直接从 request 中解析，整个请求只解析一遍，输入流由当前线程复用
+    Serializer::useReader(request.data(), request.size(), Serializable::DEFAULT_CODEC, [&](std::istream &is)
     {
-        LOG4CPLUS_WARN(logger, "No such procedure: " + name);
+        dispatch(is, response, arrival, deadline);
+    });
+}
+
+inline void RPCFramework::rejectRequest(const std::string &request, std::string &response, ReturnPacket<void>::code_t code)
+{
+    // 只解析请求头，得到编号与编码方式
+    RequestHeader header;
+    Codec codec = Serializable::DEFAULT_CODEC;
+    Serializer::useReader(request.data(), request.size(), Serializable::DEFAULT_CODEC, [&](std::istream &is)
+    {
+        try
+        {
+            Serializable::DeSerialize(is, header);
+            codec = header.codec;
+        }
+        catch(const std::exception& e)
+        {
+            LOG4CPLUS_WARN(logger, "Malformed request header: " + std::string(e.what()));
+        }
+    });
+
+    Frame::reserve(response);
+    ResponseHeader::write(response, header.seq);
+    makeResponse(ReturnPacket<void>(code), codec, response);
+}
+
+inline void RPCFramework::dispatch(std::istream &is, std::string &response, RPCContext::clock::time_point arrival, RPCContext::clock::time_point deadline)
+{
+    RequestHeader header;
+    bool malformed = false;
+    try
+    {
+        Serializable::DeSerialize(is, header);
+    }
+    catch(const std::exception& e)
+    {
+        LOG4CPLUS_WARN(logger, "Malformed request header: " + std::string(e.what()));
+        malformed = true;
+    }
+
+    // 帧头与响应头，之后的 makeResponse 只改写 ReturnPacket 部分
+    Frame::reserve(response);
+    ResponseHeader::write(response, header.seq);
+    if (malformed)
+    {
+        ReturnPacket<void> retPack(ReturnPacket<void>::UNKNOWN);
+        return makeResponse(retPack, Serializable::DEFAULT_CODEC, response);
+    }
+
+    if(!frozen || header.id >= methods.size()) // 编号即下标，只需要检查边界
+    {
+        LOG4CPLUS_WARN(logger, "No such procedure: #" + std::to_string(header.id));
         ReturnPacket<void> retPack(ReturnPacket<void>::NO_SUCH_PROCEDURE);
-        return Serializer::Serialize(retPack);
+        return makeResponse(retPack, header.codec, response);
     }
-    auto procedure = procedures[name];
+    auto &procedure = methods[header.id];
     auto startTime = std::chrono::steady_clock::now();
 
-    std::string ret;
+    // 客户端已经不再等待的请求，不再调用过程
+    if (header.timeout != RequestHeader::NO_TIMEOUT)
+    {
+        if (arrival == RPCContext::clock::time_point())
+            arrival = startTime;
+        deadline = std::min(deadline, arrival + std::chrono::microseconds(header.timeout));
+    }
+    if (deadline <= startTime)
+    {
+        expired.fetch_add(1, std::memory_order_relaxed);
+        ReturnPacket<void> retPack(ReturnPacket<void>::DEADLINE_EXCEEDED);
+        return makeResponse(retPack, header.codec, response);
+    }
+    RPCContext context(deadline);
+    RPCContext::Scope scope(context);
+
     try
     {
-        ret = procedure(request); // 实际上调用的是 callProxy
+        procedure(is, response); // 实际上调用的是 callProxy
     }
     catch(const std::exception& e)
     {
-        LOG4CPLUS_ERROR(logger, "Handler procedure \'" + name +  "\' error, message: " + std::string(e.what()));
+        LOG4CPLUS_ERROR(logger, "Handler procedure \'" + nameOf(header.id) +  "\' error, message: " + std::string(e.what()));
         ReturnPacket<void> retPack(ReturnPacket<void>::UNKNOWN);
-        return Serializer::Serialize(retPack);
+        return makeResponse(retPack, header.codec, response);
     }
     
     auto endTime = std::chrono::steady_clock::now();
     auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(endTime - startTime).count();
     if(duration >= criticalTime)
-        LOG4CPLUS_WARN(logger, "Procedure '" + name + "' runtime exceeded, cost " + std::to_string(duration) + " ms");
-    return ret;
+        LOG4CPLUS_WARN(logger, "Procedure '" + nameOf(header.id) + "' runtime exceeded, cost " + std::to_string(duration) + " ms");
+}
+
+inline void RPCFramework::freeze()
+{
+    if (frozen)
+        return;
+
+    std::vector<std::string> names;
+    for (const auto &p : procedures)
+        names.push_back(p.first);
+    nameIndex = PerfectHash(names);
+
+    methods.resize(names.size() + 1);
+    methods[RequestHeader::LOOKUP_ID] = std::bind(&RPCFramework::lookupProcedure, this, std::placeholders::_1, std::placeholders::_2);
+    for (auto &p : procedures)
+        methods[nameIndex.find(p.first) + 1] = std::move(p.second);
+    procedures.clear();
+    invokers.resize(names.size() + 1);
+    for (auto &p : localProcedures)
+        invokers[nameIndex.find(p.first) + 1] = std::move(p.second);
+    localProcedures.clear();
+    frozen = true;
+    LOG4CPLUS_INFO(logger, "Freeze " + std::to_string(names.size()) + " procedures");
+}
+
+template <typename R>
+void RPCFramework::makeResponse(const ReturnPacket<R> &retPack, Codec codec, std::string &response)
+{
+    // 保留 dispatch 写入的帧头与响应头，丢弃之前写入了一部分的 ReturnPacket（例如序列化时抛出了异常）
+    response.resize(Frame::HEADER_SIZE + ResponseHeader::SIZE);
+    Serializer::Serialize(retPack, response, codec);
+    Frame::finish(response);
+}
+
+inline void RPCFramework::lookupProcedure(std::istream &is, std::string &response)
+{
+    std::string name;
+    Serializable::DeSerialize(is, name);
+    size_t slot = nameIndex.find(name);
+    if (!is || slot == PerfectHash::NPOS)
+    {
+        LOG4CPLUS_WARN(logger, "No such procedure: " + name);
+        ReturnPacket<uint32_t> retPack(ReturnPacket<uint32_t>::NO_SUCH_PROCEDURE);
+        return makeResponse(retPack, Serializable::getCodec(is), response);
+    }
+    ReturnPacket<uint32_t> retPack(ReturnPacket<uint32_t>::SUCCESS, static_cast<uint32_t>(slot + 1));
+    makeResponse(retPack, Serializable::getCodec(is), response);
+}
+
+inline const LocalEndpoint::invoker_t *RPCFramework::findInvoker(const std::string &name) const
+{
+    if (!frozen)
+        return nullptr;
+    size_t slot = nameIndex.find(name);
+    if (slot == PerfectHash::NPOS)
+        return nullptr;
+    return &invokers[slot + 1];
+}
+
+inline std::string RPCFramework::nameOf(uint32_t id) const
+{
+    if (id == RequestHeader::LOOKUP_ID)
+        return "lookup";
+    return nameIndex.keyAt(id - 1);
 }
 
 template <typename Func>
 void RPCFramework::registerProcedure(const std::string &name, Func procedure)
 {
+    if (frozen)
+        throw std::runtime_error("registerProcedure: can not register procedure after start");
     LOG4CPLUS_INFO(logger, "Regist procedure " + name);
     // bind callProxy 的函数指针，记得传入 this 指针，因为 callProxy 不是静态的
-    procedures[name] = std::bind(&RPCFramework::callProxy<Func>, this, procedure, std::placeholders::_1);
+    procedures[name] = std::bind(&RPCFramework::callProxy<Func>, this, procedure, std::placeholders::_1, std::placeholders::_2);
+    localProcedures[name] = makeInvoker(name, procedure);
 }
 
 template <typename Obj, typename Func>
 void RPCFramework::registerProcedure(const std::string &name, Obj &obj, Func procedure)
 {
+    if (frozen)
+        throw std::runtime_error("registerProcedure: can not register procedure after start");
     LOG4CPLUS_INFO(logger, "Regist procedure " + name);
     // 注意，这里需要使用 std::ref 获取 obj 的引用
-    procedures[name] = std::bind(&RPCFramework::callProxy<Obj, Func>, this, std::ref(obj), procedure, std::placeholders::_1);
+    procedures[name] = std::bind(&RPCFramework::callProxy<Obj, Func>, this, std::ref(obj), procedure, std::placeholders::_1, std::placeholders::_2);
+    localProcedures[name] = makeInvoker(name, obj, procedure);
 }
 
 template <typename Func>
-std::string RPCFramework::callProxy(Func f, const std::string &req)
+void RPCFramework::callProxy(const Func &f, std::istream &is, std::string &response)
 {
-    return callProxyHelper(f, req);
+    callProxyHelper(f, is, response);
 }
 
 template <typename Obj, typename Func>
-std::string RPCFramework::callProxy(Obj &obj, Func f, const std::string &req)
+void RPCFramework::callProxy(Obj &obj, const Func &f, std::istream &is, std::string &response)
 {
-    return callProxyHelper(obj, f, req);
+    callProxyHelper(obj, f, is, response);
 }
 
 template <typename R, typename ...Args>
-std::string RPCFramework::callProxyHelper(std::function<R(Args ...)> f, const std::string &req)   
+void RPCFramework::callProxyHelper(const std::function<R(Args ...)> &f, std::istream &is, std::string &response)   
 {
-    ProcedurePacket<Args...> packet = Serializer::Deserialize<ProcedurePacket<Args...>>(req);
-    auto args = packet.t;
-    typename RetType<R>::type ret = invoke<R>(f, args);
-    ReturnPacket<R> retPack(ReturnPacket<R>::SUCCESS, ret);
-    return Serializer::Serialize(retPack);
-    // return Serializer::Serialize(ret);
+    callWithArgs<R, Args...>(f, is, response);
 }
 
 template <typename R, typename ...Args>
-std::string RPCFramework::callProxyHelper(R(*f)(Args ...), const std::string &req)   
+void RPCFramework::callProxyHelper(R(*f)(Args ...), std::istream &is, std::string &response)   
 {
-    std::function<R(Args...)> func(f);
-    return callProxyHelper(func, req);
+    callWithArgs<R, Args...>(f, is, response);
 }
 
 template <typename R, typename Obj, typename ...Args>
-std::string RPCFramework::callProxyHelper(Obj &obj, R(Obj::*f)(Args...), const std::string &req)
+void RPCFramework::callProxyHelper(Obj &obj, R(Obj::*f)(Args...), std::istream &is, std::string &response)
 {
-    ProcedurePacket<Args...> packet = Serializer::Deserialize<ProcedurePacket<Args...>>(req);
-    auto args = packet.t;
-
-    std::function<R(Args...)> func = [&](Args ...a)
+    auto func = [&](Args ...a)
     {
         // error: must use ‘.*’ or ‘->*’ to call pointer-to-member function in ‘f (...)’, e.g. ‘(... ->* f) (...)’
         // return obj.*f(a...);
         return (obj.*f)(a...); // 注意这里，是调用参数里面的 f
     };
+    callWithArgs<R, Args...>(func, is, response);
+}
 
-    typename RetType<R>::type ret = invoke<R>(func, args);
+template <typename R, typename ...Args, typename Function>
+void RPCFramework::callWithArgs(Function &&f, std::istream &is, std::string &response)
+{
+    std::tuple<std::decay_t<Args>...> args;
+    expand_tuple(is, args);
+    if (!is)
+        throw std::runtime_error("malformed arguments");
+
+    typename RetType<R>::type ret = invoke<R>(f, args);
     ReturnPacket<R> retPack(ReturnPacket<R>::SUCCESS, ret);
-    return Serializer::Serialize(retPack);
-    // return Serializer::Serialize(ret);
-}
\ No newline at end of file
+    makeResponse(retPack, Serializable::getCodec(is), response);
+}
+template <typename R, typename ...Args>
+LocalEndpoint::invoker_t RPCFramework::makeInvoker(const std::string &name, const std::function<R(Args ...)> &f)
+{
+    return makeTypedInvoker<R, Args...>(name, f);
+}
+
+template <typename R, typename ...Args>
+LocalEndpoint::invoker_t RPCFramework::makeInvoker(const std::string &name, R(*f)(Args ...))
+{
+    return makeTypedInvoker<R, Args...>(name, f);
+}
+
+template <typename R, typename Obj, typename ...Args>
+LocalEndpoint::invoker_t RPCFramework::makeInvoker(const std::string &name, Obj &obj, R(Obj::*f)(Args...))
+{
+    Obj *target = &obj;
+    auto func = [target, f](Args ...a)
+    {
+        return (target->*f)(a...);
+    };
+    return makeTypedInvoker<R, Args...>(name, func);
+}
+
+template <typename R, typename ...Args, typename Function>
+LocalEndpoint::invoker_t RPCFramework::makeTypedInvoker(const std::string &name, Function f)
+{
+    using ret_t = typename RetType<R>::type;
+    using args_t = std::tuple<std::decay_t<Args>...>;
+    return [this, name, f](const std::type_info &signature, void *args, void *ret) -> int
+    {
+        // 调用者的参数类型与注册时不一致（例如 const char * 与 std::string），交给调用者退回到序列化的方式
+        if (signature != typeid(ret_t(std::decay_t<Args>...)))
+            return MISMATCH;
+        try
+        {
+            *static_cast<ret_t *>(ret) = invoke<R>(f, *static_cast<args_t *>(args));
+        }
+        catch(const std::exception& e)
+        {
+            LOG4CPLUS_ERROR(logger, "Handler procedure \'" + name +  "\' error, message: " + std::string(e.what()));
+            return ReturnPacket<R>::UNKNOWN;
+        }
+        return ReturnPacket<R>::SUCCESS;
+    };
+}
@@ -4,10 +4,18 @@
 #include "ThreadPool.h"
 #include "TaskQueue.hpp"
 #include "RPCFramework.hpp"
+#include "Frame.hpp"
+#include "OutputQueue.hpp"
+#include "MPSCQueue.hpp"
+#include "IOUring.hpp"
+#include "SharedMemory.hpp"
+#include "TimerWheel.hpp"
+#include "LoadBalancer.hpp"
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <memory>
 #include <vector>
 #include <unordered_map>
-#include <queue>
 #include <functional>
 #include <mutex>
 #include <condition_variable>
@@ -16,6 +24,40 @@
 #include <log4cplus/configurator.h>
 #include <log4cplus/loggingmacros.h>
 #include <fcntl.h>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+
+struct RPCServerOptions;
+
+// reactor 的实现方式
+enum class ReactorBackend
+{
+    EPOLL,   // epoll_wait + recv/send
+    IO_URING // io_uring：multishot accept、multishot recv（provided buffer ring）、链接的 sendmsg
+};
+
+// RPCServer 的运行统计，所有 sub reactor 累计
+struct RPCServerStats
+{
+    uint64_t flushes = 0;   // 写出响应的系统调用次数
+    uint64_t responses = 0; // 写出的响应数
+    uint64_t bytes = 0;     // 写出的字节数
+    uint64_t connections = 0; // 当前的连接数
+    uint64_t rejected = 0;    // 因连接数达到上限或文件描述符耗尽而拒绝的连接数
+    uint64_t idle_closed = 0; // 因空闲超时而关闭的连接数
+    uint64_t expired = 0;     // 超过期限（客户端的超时时间或 request_timeout）、没有调用过程的请求数
+    uint64_t overloaded = 0;  // 因任务队列已满而回复 OVERLOADED 的请求数
+    uint64_t queued = 0;      // 当前排队中的请求数（所有 sub reactor）
+    std::vector<size_t> queue_depths; // 每个 sub reactor 当前排队中的请求数
+    int lifo = 0;             // 当前因排队时间持续超过 queue_delay_target 而改为 LIFO 的工作线程数
+    std::vector<int> reactor_connections; // 每个 sub reactor 当前的连接数
+    std::vector<int> reactor_inflight;    // 每个 sub reactor 当前进行中（排队或正在执行）的请求数
+
+    // 写合并的效果：平均每次系统调用写出的响应数
+    double batching() const
+    {return flushes == 0 ? 0 : static_cast<double>(responses) / flushes;}
+};
 
 /**
  * @brief 基于多 Reacor 多线程实现的 RPCServer
@@ -25,11 +67,23 @@
  */
 class RPCServer
 {
+    struct Inbox;
+
     // configs
     uint16_t reactor_nums;          // reactor 的总数量
     uint16_t task_thread_nums;      // 每个 reactor 拥有的 task thread 数
     size_t epoll_buffer_size;       // 单次循环 epoll_event 的最大值
     int epoll_wait_timeout;         // epoll_wait 的超时时间
+    std::chrono::microseconds cork_time; // 写合并的最长等待时间
+    size_t cork_bytes;              // 待写出的数据达到该值时，不再等待
+    bool reuse_port;                // 每个 sub reactor 各自监听、accept，不使用 main reactor
+    size_t max_connections;         // 最大连接数，为 0 时不限制
+    std::chrono::milliseconds idle_timeout;    // 连接空闲超过该时间后关闭，为 0 时不关闭
+    std::chrono::milliseconds request_timeout; // 请求在队列中等待超过该时间后不再处理，为 0 时不限制
+    size_t queue_capacity;          // 每个 sub reactor 的任务队列的容量，为 0 时不限制
+    OverflowPolicy overflow_policy; // 任务队列已满时的处理方式
+    AdmissionControl admission;     // 基于排队时间的准入控制
+    ReactorBackend backend;         // reactor 的实现方式
 
     // member vars
     TCPSocket srv_sock;             // Server 的 socket
@@ -38,23 +92,48 @@ class RPCServer
     log4cplus::Logger logger;       // 记录除了错误日志的其它日志
     log4cplus::Logger errorLogger;  // 记录错误日志
 
+    std::unique_ptr<TCPSocket> unix_sock;               // 同时监听的 AF_UNIX socket，与 TCP 共用 reactor
+    int unix_fd = -1;
+    std::unique_ptr<TCPSocket> shm_sock;                // 共享内存客户端的控制连接在此 AF_UNIX socket 上建立
+    int shm_fd = -1;
+    std::vector<std::unique_ptr<TCPSocket>> listeners;  // reuse_port 模式下，除 srv_sock 之外的监听 socket
+    std::vector<std::pair<int, int>> acceptors;         // reuse_port、io_uring 模式下，每个 sub reactor 的 epoll 实例（io_uring 实例）及其监听的 socket
+    std::vector<std::unique_ptr<IOUring>> rings;        // io_uring 模式下，每个 sub reactor 的 io_uring 实例，需要在 reactors 之后析构
+
     int main_epfd;                      // 主 reactor 的 epoll 实例
-    std::mutex epfds_lock;              // 互斥访问 epfds
-    std::unordered_map<int, int> epfds; // 记录每个 sub reactor 的 active connections
-    std::function<bool(int, int)> cmp = [this](int epfd0, int epfd1) -> bool
-    {
-        return epfds.at(epfd0) > epfds.at(epfd1);
-    };
-    std::priority_queue<int, std::vector<int>, decltype(cmp)> pq{cmp};  // 小根堆，每次选择监视 socket 数量最小的 epfd
+    LoadBalancer balancer;              // 记录每个 sub reactor 的活跃连接数、进行中的请求数，并为新连接选择 sub reactor
+    std::unordered_map<int, std::unique_ptr<Inbox>> inboxes;            // epoll sub reactor 的 epfd -> Inbox，构造之后只读
     ThreadPool reactors;                                                // 使用线程池管理主从 reactor
     std::atomic<int> active_reactors;                                   // 当前活跃的 reactor 数
 
+    std::atomic<size_t> connections{0}; // 当前的连接数
+    std::mutex spare_lock;              // 互斥使用 spare_fd
+    int spare_fd;                       // 预留的文件描述符，文件描述符耗尽时释放它，用来 accept 并关闭多余的连接
+
+    // stats
+    std::atomic<uint64_t> flushes{0};
+    std::atomic<uint64_t> flushed_responses{0};
+    std::atomic<uint64_t> flushed_bytes{0};
+    std::atomic<uint64_t> rejected{0};
+    std::atomic<uint64_t> idle_closed{0};
+    std::atomic<uint64_t> overloaded{0};
+    mutable std::mutex queues_lock;     // 互斥访问 queues
+    std::vector<TaskQueue *> queues;    // 各个 sub reactor 的任务队列，用于导出队列长度
+
 public:
     static constexpr uint16_t DEFAULT_REACTOR_NUM = 2;                // 默认 1 主 1 从
     static constexpr int DEFAULT_BACKLOG = INT32_MAX;                 // 默认全连接数
     static constexpr uint16_t DEFAULT_TASK_THREAD_HOLD = 8;           // 默认一个 epoll 实例最多可以开的线程数
     static constexpr size_t DEFAULT_EPOLL_BUFFER_SIZE = 4096;         // 默认一个 epoll 实例的 buffer 的大小
     static constexpr int DEFAULT_EPOLL_WAIT_TIME = 5000;              // 默认 epoll_wait 的等待时间
+    static constexpr int DEFAULT_CORK_TIME = 0;                       // 默认不等待，每轮循环结束时写出
+    static constexpr size_t DEFAULT_CORK_BYTES = 64 * 1024;           // 默认写合并的字节数上限
+    static constexpr size_t DEFAULT_MAX_CONNECTIONS = 0;              // 默认不限制连接数
+    static constexpr int DEFAULT_IDLE_TIMEOUT = 0;                    // 默认不关闭空闲连接
+    static constexpr int DEFAULT_REQUEST_TIMEOUT = 0;                 // 默认不限制请求的排队时间
+    static constexpr size_t DEFAULT_QUEUE_CAPACITY = 8192;            // 默认每个 sub reactor 最多排队的请求数
+    static constexpr int DEFAULT_QUEUE_DELAY_TARGET = 0;              // 默认不根据排队时间丢弃请求
+    static constexpr int DEFAULT_QUEUE_DELAY_INTERVAL = 100;          // 默认观察排队时间的周期（毫秒）
 
     /**
      * @brief 创建 RPC 服务
@@ -73,10 +152,26 @@ public:
               size_t epoll_buffer_size = DEFAULT_EPOLL_BUFFER_SIZE,
               int epoll_wait_time = DEFAULT_EPOLL_WAIT_TIME);
 
+    /**
+     * @brief 创建 RPC 服务，使用 RPCServerOptions 指定全部配置
+     * 
+     * @param ip      服务器监听的 IP
+     * @param port    服务器监听的端口
+     * @param options 配置
+     */
+    RPCServer(const std::string &ip, uint16_t port, const RPCServerOptions &options);
+
     ~RPCServer();
 
     void start();
 
+    // 运行统计
+    RPCServerStats stats() const;
+
+    // 服务端的 RPCFramework，同一进程中的调用者可以通过 RPCClient(LocalEndpoint &) 直接调用已注册的过程（start 之后）
+    RPCFramework &getFramework()
+    {return framework;}
+
     /**
      * @brief 注册 RPC 服务
      * 
@@ -99,23 +194,210 @@ public:
     template <typename Obj, typename Func>
     void registerProcedure(const std::string &name, Obj &obj, Func procedure);
 private:
+    // 连接的状态，由所属的 sub reactor 与处理该连接请求的工作线程共享
+    // epoll 后端中，连接对象保存在 sub reactor 以 fd 为下标的 slab 中，关闭后不释放，由之后复用该 fd 的连接继续使用
+    struct Connection
+    {
+        int fd;
+        uint32_t generation = 0; // 连接对象每被复用一次加一，工作线程据此丢弃已关闭的连接的响应；reactor 在 write_lock 内修改
+        FrameDecoder input;  // 输入缓冲区，保存不完整的请求帧，只在 reactor 线程中访问
+        bool unread = false; // 上次读满了 READ_BUDGET，socket 中可能还有数据，在下一轮循环中继续读取；只在 reactor 线程中访问
+        std::atomic<uint32_t> inflight{0}; // 已交给工作线程、还未完成的请求数
+        std::chrono::steady_clock::time_point last_active; // 最近一次收到数据的时间，只在 reactor 线程中访问
+        std::atomic<std::chrono::steady_clock::rep> drained{0}; // 最近一次请求全部完成（inflight 变为 0）的时间，由工作线程写入
+        TimerNode idle_timer;    // 空闲超时的定时器，只在 reactor 线程中访问
+
+        std::mutex write_lock;             // 保护 output、closed，写 socket 时持有
+        OutputQueue output;                // 输出队列，保存还未写出的响应帧
+        bool closed = false;               // 连接已经关闭，fd 可能已被复用，不能再写
+        std::atomic<bool> backlogged{false}; // output 中有数据等待写出，reactor 收到写事件时才需要加锁
+        std::atomic<bool> notified{false};   // 已经交给 reactor 写出（写合并），避免重复入队
+
+        bool dirty = false;  // 是否在待写出的列表中，只在 reactor 线程中访问
+        std::chrono::steady_clock::time_point dirty_since; // 加入待写出列表的时间，用于写合并
+
+        // io_uring 后端使用，只在 reactor 线程中访问
+        bool receiving = false;  // multishot recv 仍然有效
+        size_t sending = 0;      // 已提交、还未完成的 sendmsg 数
+        bool released = false;   // fd 已经关闭、已从 conns 中移除，完成事件的处理函数可能仍持有连接对象
+        std::vector<iovec> iov;  // 提交中的 sendmsg 引用的数据，完成之前不能修改
+        std::vector<msghdr> msgs;
+
+        std::unique_ptr<ShmRegion> shm; // 共享内存连接（fd 为控制连接），请求、响应都经过共享内存中的环形缓冲区
+
+        explicit Connection(int fd) : fd(fd) {}
+    };
+
+    // 累计写出的统计
+    void count(const OutputQueue::Stats &st);
+
+    // 在工作线程中处理一个请求，arrival 为收到请求的时间；超过期限（请求头中的超时时间或 request_timeout）的请求直接回复 DEADLINE_EXCEEDED
+    void serve(const std::string &request, std::string &response, std::chrono::steady_clock::time_point arrival);
+
+    // 任务队列已满、请求被丢弃时调用：不调用过程，直接回复 OVERLOADED
+    void shed(const std::string &request, std::string &response);
+
+    // 在作用域内把 sub reactor 的任务队列登记到 queues 中，用于导出队列长度
+    class QueueGauge
+    {
+        RPCServer *srv;
+        TaskQueue *tq;
+
+    public:
+        QueueGauge(RPCServer *srv, TaskQueue &tq)
+            : srv(srv), tq(&tq)
+        {
+            std::lock_guard<std::mutex> lock(srv->queues_lock);
+            srv->queues.push_back(this->tq);
+        }
+
+        ~QueueGauge()
+        {
+            std::lock_guard<std::mutex> lock(srv->queues_lock);
+            srv->queues.erase(std::find(srv->queues.begin(), srv->queues.end(), tq));
+        }
+    };
+
+    static constexpr unsigned URING_ENTRIES = 1024;          // io_uring 提交队列的大小
+    static constexpr unsigned URING_BUFFERS = 256;           // 每个 io_uring 实例提供给 recv 的缓冲区数
+    static constexpr unsigned URING_BUFFER_SIZE = 16 * 1024; // 每个缓冲区的大小
+    static constexpr size_t URING_SEND_LINKS = 4;            // 一个连接一次最多提交的链接的 sendmsg 数
+    static constexpr size_t READ_BUDGET = 256 * 1024;        // epoll 后端中每个连接（socket 或共享内存）每轮循环最多读取的字节数，读满后先处理其它连接
+
+    // sub reactor 的 epoll_event.data：连接的 socket 直接为连接对象的地址（data.ptr），不需要再查找；
+    // 其它的事件用低 2 位区分，连接对象至少 8 字节对齐，低 2 位总是 0
+    enum : uint64_t {EVENT_SOCKET = 0, EVENT_SHM_CONTROL = 1, EVENT_SHM_WAKE = 2, EVENT_FD = 3, EVENT_KIND_MASK = 3};
+
+    static uint64_t event_conn(Connection *conn, uint64_t kind)
+    {return reinterpret_cast<uintptr_t>(conn) | kind;}
+
+    // 监听 socket、eventfd 等不属于某个连接的 fd
+    static uint64_t event_fd(int fd)
+    {return static_cast<uint64_t>(fd) << 2 | EVENT_FD;}
+
+    // 每个 epoll sub reactor 接收新连接的队列：其它线程 accept 的连接经由它交给 sub reactor，
+    // 由 sub reactor 自己在 slab 中取得连接对象并注册到 epoll，slab 不需要加锁
+    struct Inbox
+    {
+        MPSCQueue<std::pair<int, uint64_t>> conns; // fd 与事件类型（EVENT_SOCKET 或 EVENT_SHM_CONTROL）
+        std::atomic<bool> signaled{false};         // eventfd 已经写入、reactor 还未处理
+        int efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC); // 与工作线程共用，唤醒 sub reactor
+
+        ~Inbox()
+        {
+            if (efd != -1)
+                close(efd);
+        }
+    };
+
+    // 检查连接数上限，允许时计入连接数；否则关闭 clnt_sock，返回 false
+    bool admit_connection(int clnt_sock);
+
+    /**
+     * @brief 接受 listen_fd 上所有等待的连接，直到 EAGAIN
+     * 
+     * @param listen_fd 非阻塞的监听 socket
+     * @param epfd      接收新连接的 sub reactor，为 -1 时，每个连接交给连接数最少的 sub reactor
+     */
+    void accept_connections(int listen_fd, int epfd);
+
+    // 文件描述符耗尽时，用预留的文件描述符接受一个连接并立即关闭，避免它一直留在全连接队列中，监听 socket 持续可读
+    bool shed_connection(int listen_fd);
+
+    // 将新连接交给 epfd 对应的 sub reactor，kind 为 EVENT_SOCKET 或 EVENT_SHM_CONTROL
+    void register_connection(int epfd, int clnt_sock, uint64_t kind = EVENT_SOCKET);
+
     static void accept_handler(RPCServer *rpc_srv);
 
+    // 新连接由 acceptor（main reactor，或者 reuse_port 模式下 epfd 上监听 socket 的读事件）经 Inbox 交给该 sub reactor
     static void request_handler(RPCServer *rpc_srv, int epfd);
 
+    // io_uring 后端的 sub reactor，对 listen_fd（以及 unix_fd）发起 multishot accept，自己处理接受的连接
+    static void uring_handler(RPCServer *rpc_srv, IOUring *ring, int listen_fd);
+
     static void sig_handler(int sig);
 
-    static bool exited;
+    static std::atomic<bool> exited; // 由信号处理函数设置，lock-free 的原子变量可以在信号处理函数中使用
+};
+
+/**
+ * @brief RPCServer 的配置，前几项与 RPCServer 构造函数的参数相同
+ * 
+ */
+struct RPCServerOptions
+{
+    int backlog = RPCServer::DEFAULT_BACKLOG;                          // 全连接队列的大小
+    uint16_t reactor_nums = RPCServer::DEFAULT_REACTOR_NUM;            // reactor 的总数量
+    uint16_t task_thread_nums = RPCServer::DEFAULT_TASK_THREAD_HOLD;   // 每个 reactor 拥有的 task thread 数
+    size_t epoll_buffer_size = RPCServer::DEFAULT_EPOLL_BUFFER_SIZE;   // 单次循环 epoll_event 的最大值
+    int epoll_wait_time = RPCServer::DEFAULT_EPOLL_WAIT_TIME;          // epoll_wait 的超时时间
+
+    // 写合并：同一连接的响应先缓存起来，最多等待 cork_time 微秒，或者累计到 cork_bytes 字节后，一次写出
+    // 用一点延迟换取更少的系统调用；等待的精度受 epoll_wait 限制，为毫秒级
+    int cork_time = RPCServer::DEFAULT_CORK_TIME;
+    size_t cork_bytes = RPCServer::DEFAULT_CORK_BYTES;
+
+    // 多 acceptor 模式：每个 reactor 都有自己的监听 socket（SO_REUSEPORT），直接 accept，由内核均衡分配连接
+    // 此时没有 main reactor，reactor_nums 个 reactor 都是 sub reactor
+    bool reuse_port = false;
+
+    // 最大连接数，超过后新的连接会被立即关闭，为 0 时不限制
+    size_t max_connections = RPCServer::DEFAULT_MAX_CONNECTIONS;
+
+    // 空闲连接的超时时间（毫秒）：超过该时间没有收到数据、也没有未完成的请求的连接会被关闭，为 0 时不关闭。只支持 epoll 后端
+    int idle_timeout = RPCServer::DEFAULT_IDLE_TIMEOUT;
+
+    // 请求的超时时间（毫秒）：请求在任务队列中等待超过该时间后，不再调用过程，直接回复 DEADLINE_EXCEEDED，为 0 时不限制
+    int request_timeout = RPCServer::DEFAULT_REQUEST_TIMEOUT;
+
+    // 每个 sub reactor 的任务队列最多排队的请求数（平均分给各个工作线程），为 0 时不限制
+    // 队列已满时按照 overflow_policy 处理，被拒绝、被丢弃的请求立即回复 OVERLOADED
+    size_t queue_capacity = RPCServer::DEFAULT_QUEUE_CAPACITY;
+    OverflowPolicy overflow_policy = OverflowPolicy::REJECT;
+
+    // 排队时间的目标（毫秒），为 0 时不启用：queue_delay_interval 内最短的排队时间都超过该值时认为过载，
+    // 工作线程改为先处理最新的请求，排队超过该值的请求立即回复 OVERLOADED；排队时间回落后恢复
+    int queue_delay_target = RPCServer::DEFAULT_QUEUE_DELAY_TARGET;
+    int queue_delay_interval = RPCServer::DEFAULT_QUEUE_DELAY_INTERVAL;
+
+    // reactor 的实现方式；使用 io_uring 时没有 main reactor，每个 reactor 都直接 accept（与 reuse_port 相同），
+    // 响应总是交给 reactor 在每轮循环中合并写出，不使用 cork_time
+    ReactorBackend backend = ReactorBackend::EPOLL;
+
+    // 在 TCP 之外，同时监听的 AF_UNIX 路径，为空时不监听；同一主机上的客户端使用 "unix:/path" 连接，
+    // 帧格式、reactor 与 TCP 相同。只监听 AF_UNIX 时，将构造函数的 ip 设为 "unix:/path" 即可
+    std::string unix_path;
+
+    // 共享内存传输的控制 socket（AF_UNIX）路径，为空时不启用；同一主机上的客户端使用 "shm:/path" 连接，
+    // 通过该 socket 交来 memfd 与 eventfd，之后请求、响应都经过共享内存中的环形缓冲区，不经过内核。只支持 epoll 后端
+    std::string shm_path;
 };
 
-bool RPCServer::exited = false;
+std::atomic<bool> RPCServer::exited{false};
 
 RPCServer::RPCServer(const std::string &ip, uint16_t port, int backlog, 
                      uint16_t reactor_nums, 
                      uint16_t task_thread_nums, 
                      size_t epoll_buffer_size,
                      int epoll_wait_time)
-    : reactor_nums(reactor_nums), task_thread_nums(task_thread_nums), epoll_buffer_size(epoll_buffer_size), reactors(reactor_nums), srv_sock(ip, port, backlog), epoll_wait_timeout(epoll_wait_time)
+    : RPCServer(ip, port, [&]()
+      {
+          // 其余配置使用默认值
+          RPCServerOptions options;
+          options.backlog = backlog;
+          options.reactor_nums = reactor_nums;
+          options.task_thread_nums = task_thread_nums;
+          options.epoll_buffer_size = epoll_buffer_size;
+          options.epoll_wait_time = epoll_wait_time;
+          return options;
+      }()) {}
+
+RPCServer::RPCServer(const std::string &ip, uint16_t port, const RPCServerOptions &options)
+    : reactor_nums(options.reactor_nums), task_thread_nums(options.task_thread_nums), epoll_buffer_size(options.epoll_buffer_size), 
+      epoll_wait_timeout(options.epoll_wait_time), cork_time(options.cork_time), cork_bytes(options.cork_bytes), reuse_port(options.reuse_port),
+      max_connections(options.max_connections), idle_timeout(options.idle_timeout), request_timeout(options.request_timeout),
+      queue_capacity(options.queue_capacity), overflow_policy(options.overflow_policy),
+      admission{std::chrono::milliseconds(options.queue_delay_target), std::chrono::milliseconds(options.queue_delay_interval)}, backend(options.backend), srv_sock(ip, port, options.backlog, options.reuse_port), reactors(options.reactor_nums)
 {
     log4cplus::initialize();
     log4cplus::PropertyConfigurator::doConfigure("Log/config/log4cplus.properties"); // 配置文件的路径
@@ -130,33 +412,115 @@ RPCServer::RPCServer(const std::string &ip, uint16_t port, int backlog,
     }
     LOG4CPLUS_INFO(logger, "Initialize log4cplus successfully");
 
+    spare_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+
+    if (!options.unix_path.empty())
+    {
+        unix_sock.reset(new TCPSocket("unix:" + options.unix_path, 0, options.backlog));
+        unix_fd = unix_sock->native_sock();
+        fcntl(unix_fd, F_SETFL, O_NONBLOCK);
+        LOG4CPLUS_INFO(logger, "Listen on unix domain socket " + options.unix_path);
+    }
+    if (!options.shm_path.empty())
+    {
+        if (backend == ReactorBackend::IO_URING)
+            throw std::runtime_error("shared memory transport requires the epoll backend");
+        shm_sock.reset(new TCPSocket("unix:" + options.shm_path, 0, options.backlog));
+        shm_fd = shm_sock->native_sock();
+        fcntl(shm_fd, F_SETFL, O_NONBLOCK);
+        LOG4CPLUS_INFO(logger, "Listen on shared memory control socket " + options.shm_path);
+    }
+    if (admission.enabled() && admission.interval.count() <= 0)
+        throw std::runtime_error("queue_delay_interval must be positive");
+
+    if (reuse_port || backend == ReactorBackend::IO_URING)
+    {
+        if (reactor_nums < 1)
+            throw std::runtime_error("at least one reactor!");
+
+        // 创建 sub reactor，每个都有自己的监听 socket（reuse_port），第一个使用 srv_sock
+        // 不使用 reuse_port 时（只有 io_uring 后端），所有 sub reactor 对 srv_sock 发起 accept，由内核选择其中一个
+        // 在 start 时才开始 accept，此前的连接留在全连接队列中
+        main_epfd = -1;
+        fcntl(srv_sock.native_sock(), F_SETFL, O_NONBLOCK);
+        for (size_t i = 0; i < reactor_nums; i++)
+        {
+            int listen_fd = srv_sock.native_sock();
+            if (i > 0 && reuse_port)
+            {
+                listeners.emplace_back(new TCPSocket(ip, port, options.backlog, true));
+                listen_fd = listeners.back()->native_sock();
+                fcntl(listen_fd, F_SETFL, O_NONBLOCK);
+            }
+            int epfd = -1;
+            if (backend == ReactorBackend::IO_URING)
+            {
+                // io_uring 实例在 reactor 线程中启用，该线程是唯一的提交者
+                rings.emplace_back(new IOUring(URING_ENTRIES, true));
+                epfd = rings.back()->fd();
+            }
+            else
+            {
+                epfd = epoll_create1(0);
+                inboxes[epfd].reset(new Inbox());
+            }
+            balancer.add(epfd);
+            acceptors.emplace_back(epfd, listen_fd);
+        }
+        // 所有 sub reactor 都加入 balancer、inboxes 之后再启动，否则运行中的 reactor 会与插入（rehash）竞争
+        if (backend == ReactorBackend::EPOLL)
+        {
+            for (auto &acceptor : acceptors)
+                reactors.enqueue(request_handler, this, acceptor.first);
+        }
+        LOG4CPLUS_INFO(logger, "Initialize " + std::to_string(reactor_nums) + " sub reactors" + (backend == ReactorBackend::IO_URING ? " with io_uring" : "") + (reuse_port ? " with SO_REUSEPORT" : "") + " successfully");
+        return;
+    }
+
     if (reactor_nums <= 1)
     {
         throw std::runtime_error("at least two reactors!");
     }
     
     // 创建 main reactor
+    fcntl(srv_sock.native_sock(), F_SETFL, O_NONBLOCK);
     main_epfd = epoll_create1(0);
     epoll_event event;
-    event.data.fd = srv_sock.native_sock();
+    event.data.u64 = srv_sock.native_sock();
     event.events = EPOLLIN;
     epoll_ctl(main_epfd, EPOLL_CTL_ADD, srv_sock.native_sock(), &event);
+    for (int fd : {unix_fd, shm_fd})
+    {
+        if (fd == -1)
+            continue;
+        event.data.u64 = fd;
+        epoll_ctl(main_epfd, EPOLL_CTL_ADD, fd, &event);
+    }
     LOG4CPLUS_INFO(logger, "Initialize main reactor successfully");
 
     for (size_t i = 1; i < reactor_nums; i++)
     {
         int epfd = epoll_create1(0);
-        epfds[epfd] = 0;
-        pq.push(epfd);
-        // 创建 sub reactor
-        reactors.enqueue(request_handler, this, epfd);
+        balancer.add(epfd);
+        inboxes[epfd].reset(new Inbox());
     }
+    // 创建 sub reactor：所有 sub reactor 都加入 balancer、inboxes 之后再启动，它们在运行期间只读
+    for (auto &inbox : inboxes)
+        reactors.enqueue(request_handler, this, inbox.first);
     LOG4CPLUS_INFO(logger, "Initialize sub reactor successfully");
 }
 
 RPCServer::~RPCServer() 
 {
     srv_sock.close();
+    for (auto &listener : listeners)
+        listener->close();
+    if (unix_sock)
+        unix_sock->close();
+    if (shm_sock)
+        shm_sock->close();
+    if (spare_fd != -1)
+        close(spare_fd);
 }
 
 void RPCServer::sig_handler(int sig_num)
@@ -170,7 +534,34 @@ void RPCServer::sig_handler(int sig_num)
 
 void RPCServer::start(void)
 {
-    reactors.enqueue(accept_handler, this);
+    framework.freeze(); // 之后不能再注册新的过程
+    if (backend == ReactorBackend::IO_URING)
+    {
+        for (size_t i = 0; i < rings.size(); i++)
+            reactors.enqueue(uring_handler, this, rings[i].get(), acceptors[i].second);
+    }
+    else if (reuse_port)
+    {
+        // 开始 accept：监听 socket 为水平触发，每个 sub reactor 只 accept 自己的监听 socket
+        for (auto &acceptor : acceptors)
+        {
+            epoll_event event;
+            event.data.u64 = event_fd(acceptor.second);
+            event.events = EPOLLIN;
+            if (epoll_ctl(acceptor.first, EPOLL_CTL_ADD, acceptor.second, &event) == -1)
+                throw std::runtime_error("epoll_ctl: EPOLL_CTL_ADD listener error: " + std::string(strerror(errno)));
+            // AF_UNIX socket 由所有 sub reactor 共同 accept，每个连接只唤醒其中一个
+            for (int fd : {unix_fd, shm_fd})
+            {
+                event.data.u64 = event_fd(fd);
+                event.events = EPOLLIN | EPOLLEXCLUSIVE;
+                if (fd != -1 && epoll_ctl(acceptor.first, EPOLL_CTL_ADD, fd, &event) == -1)
+                    throw std::runtime_error("epoll_ctl: EPOLL_CTL_ADD listener error: " + std::string(strerror(errno)));
+            }
+        }
+    }
+    else
+        reactors.enqueue(accept_handler, this);
     LOG4CPLUS_INFO(logger, "RPC Server startup is complete and can now accept RPC requests from clients");
 
     // 阻塞，直到 control^c
@@ -188,6 +579,53 @@ void RPCServer::start(void)
     LOG4CPLUS_INFO(logger, "RPC Server is about to exit...");
 }
 
+RPCServerStats RPCServer::stats() const
+{
+    RPCServerStats st;
+    st.flushes = flushes.load(std::memory_order_relaxed);
+    st.responses = flushed_responses.load(std::memory_order_relaxed);
+    st.bytes = flushed_bytes.load(std::memory_order_relaxed);
+    st.connections = connections.load(std::memory_order_relaxed);
+    st.rejected = rejected.load(std::memory_order_relaxed);
+    st.idle_closed = idle_closed.load(std::memory_order_relaxed);
+    st.expired = framework.expiredRequests();
+    st.overloaded = overloaded.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < balancer.size(); i++)
+    {
+        st.reactor_connections.push_back(balancer.connections(i));
+        st.reactor_inflight.push_back(balancer.inflight(i));
+    }
+    std::lock_guard<std::mutex> lock(queues_lock);
+    for (TaskQueue *q : queues)
+    {
+        st.queue_depths.push_back(q->size());
+        st.queued += q->size();
+        st.lifo += q->overloaded();
+    }
+    return st;
+}
+
+void RPCServer::count(const OutputQueue::Stats &st)
+{
+    if (st.calls == 0)
+        return;
+    flushes.fetch_add(st.calls, std::memory_order_relaxed);
+    flushed_responses.fetch_add(st.frames, std::memory_order_relaxed);
+    flushed_bytes.fetch_add(st.bytes, std::memory_order_relaxed);
+}
+
+void RPCServer::serve(const std::string &request, std::string &response, std::chrono::steady_clock::time_point arrival)
+{
+    auto deadline = request_timeout.count() > 0 ? arrival + request_timeout : RPCContext::NO_DEADLINE;
+    framework.handleRequest(request, response, arrival, deadline);
+}
+
+void RPCServer::shed(const std::string &request, std::string &response)
+{
+    overloaded.fetch_add(1, std::memory_order_relaxed);
+    framework.rejectRequest(request, response, ReturnPacket<void>::OVERLOADED);
+}
+
 template <typename Func>
 void RPCServer::registerProcedure(const std::string &name, Func procedure)
 {
@@ -200,10 +638,83 @@ void RPCServer::registerProcedure(const std::string &name, Obj &obj, Func proced
     framework.registerProcedure(name, obj, procedure);
 }
 
+bool RPCServer::admit_connection(int clnt_sock)
+{
+    // 连接数达到上限，直接关闭
+    size_t active = connections.fetch_add(1, std::memory_order_relaxed);
+    if (max_connections > 0 && active >= max_connections)
+    {
+        connections.fetch_sub(1, std::memory_order_relaxed);
+        rejected.fetch_add(1, std::memory_order_relaxed);
+        close(clnt_sock);
+        return false;
+    }
+    set_no_delay(clnt_sock);
+    return true;
+}
+
+void RPCServer::accept_connections(int listen_fd, int epfd)
+{
+    while (true)
+    {
+        // 直接得到非阻塞的 socket，不需要再调用 fcntl
+        int clnt_sock = accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (clnt_sock < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+            if ((errno == EMFILE || errno == ENFILE) && shed_connection(listen_fd))
+                continue;
+            LOG4CPLUS_ERROR(errorLogger, "RPCServer::accept_connections: accept4 error: " + std::string(strerror(errno)));
+            break;
+        }
+
+        if (!admit_connection(clnt_sock))
+            continue;
+
+        int target = epfd;
+        if (target == -1)
+            target = balancer.id(balancer.pick()); // 分发 clnt_sock 给 sub reactor
+        register_connection(target, clnt_sock, listen_fd == shm_fd ? EVENT_SHM_CONTROL : EVENT_SOCKET);
+    }
+}
+
+bool RPCServer::shed_connection(int listen_fd)
+{
+    std::lock_guard<std::mutex> lock(spare_lock);
+    if (spare_fd == -1)
+        return false;
+    close(spare_fd);
+    int clnt_sock = accept(listen_fd, nullptr, nullptr);
+    if (clnt_sock >= 0)
+    {
+        close(clnt_sock);
+        rejected.fetch_add(1, std::memory_order_relaxed);
+    }
+    spare_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    LOG4CPLUS_WARN(errorLogger, "RPCServer::shed_connection: too many open files, reject a connection");
+    return clnt_sock >= 0;
+}
+
+void RPCServer::register_connection(int epfd, int clnt_sock, uint64_t kind)
+{
+    balancer.connected(balancer.index(epfd));
+    // sub reactor 在本轮循环的最后注册到 epoll，注册失败时由它关闭连接
+    Inbox &inbox = *inboxes.at(epfd);
+    inbox.conns.push({clnt_sock, kind});
+    if (!inbox.signaled.exchange(true, std::memory_order_acq_rel))
+    {
+        uint64_t one = 1;
+        if (write(inbox.efd, &one, sizeof(one)) < 0)
+            LOG4CPLUS_ERROR(errorLogger, "RPCServer::register_connection: eventfd write error: " + std::string(strerror(errno)));
+    }
+}
+
 void RPCServer::accept_handler(RPCServer *rpc_srv)
 {
     epoll_event events[rpc_srv->epoll_buffer_size];
-    epoll_event ev;
     ++rpc_srv->active_reactors;
     while (true)
     {
@@ -219,34 +730,12 @@ void RPCServer::accept_handler(RPCServer *rpc_srv)
 
         for (size_t i = 0; i < eventsNum; i++)
         {
-            // 如果是连接请求事件
-            if (events[i].data.fd == rpc_srv->srv_sock.native_sock())
+            // 如果是连接请求事件（TCP 或 AF_UNIX）
+            int listen_fd = events[i].data.fd;
+            if (listen_fd == rpc_srv->srv_sock.native_sock() || listen_fd == rpc_srv->unix_fd || listen_fd == rpc_srv->shm_fd)
             {
-                // 接受连接
-                TCPSocket* clnt_sock = rpc_srv->srv_sock.accept();
-                int clnt_native_sock = clnt_sock->native_sock();
-
-                // 创建读事件
-                fcntl(clnt_native_sock, F_SETFL, O_NONBLOCK);
-                ev.events = EPOLLIN | EPOLLET;
-                ev.data.fd = clnt_native_sock;
-
-                // 分发 clnt_sock 给 sub reactor
-                int epfd = -1;
-                {
-                    std::lock_guard<std::mutex> lock(rpc_srv->epfds_lock);
-                    epfd = rpc_srv->pq.top();
-                    ++rpc_srv->epfds[epfd]; // 活跃连接数 + 1
-                    rpc_srv->pq.pop();
-                    rpc_srv->pq.push(epfd);
-                }
-                
-                // 添加新的 clnt_sock 到 epoll 实例
-                if (epoll_ctl(epfd, EPOLL_CTL_ADD, clnt_native_sock, &ev) == -1) {
-                    LOG4CPLUS_ERROR(rpc_srv->errorLogger, "RPCServer::accept_handler: epoll_ctl: EPOLL_CTL_ADD error: " + std::string(strerror(errno)));
-                    clnt_sock->close();
-                }
-                delete clnt_sock;
+                // 一次接受全连接队列中的所有连接
+                rpc_srv->accept_connections(listen_fd, -1);
             }
             // 否则，忽略事件
         }
@@ -256,16 +745,391 @@ void RPCServer::accept_handler(RPCServer *rpc_srv)
 
 void RPCServer::request_handler(RPCServer *rpc_srv, int epfd)
 {
-    TaskQueue tq(rpc_srv->task_thread_nums, 200);
-    std::unordered_map<int, std::string> resp;
-    std::mutex resp_lock;
+    Inbox &inbox = *rpc_srv->inboxes.at(epfd);
+    const int efd = inbox.efd; // 工作线程、acceptor 通知 reactor
+    const size_t slot = rpc_srv->balancer.index(epfd); // 在 balancer 中记录活跃连接数、进行中的请求数
+    BufferPool buffers; // 请求、响应缓冲区的容量在该 reactor 内循环使用，需要先于 tq 构造、后于 tq 析构
+    MPSCQueue<std::pair<Connection *, uint32_t>> handoff; // 工作线程交给 reactor 写出的连接（写合并），及其 generation
+    std::atomic<bool> signaled{false}; // 工作线程已经写入 eventfd、reactor 还未处理
+    size_t dispatched = 0; // 已分发的请求数，用于将同一连接的请求轮流分发给不同的工作线程
+    std::vector<std::unique_ptr<Connection>> slab; // 以 fd 为下标的连接对象，只在 reactor 线程中访问；对象的地址不变，关闭后留给复用该 fd 的连接
+    std::vector<Connection *> dirty; // 有响应等待写合并的连接
+    std::vector<std::pair<Connection *, uint32_t>> readable, reading; // 读满了 READ_BUDGET、下一轮循环继续读取的连接，及其 generation
+    TimerWheel timers; // 空闲连接的定时器，同时决定 epoll_wait 的超时时间
     epoll_event events[rpc_srv->epoll_buffer_size];
     epoll_event ev;
+    const bool corked = rpc_srv->cork_time.count() > 0;
+
+    ev.data.u64 = event_fd(efd);
+    ev.events = EPOLLIN | EPOLLET;
+    if (efd == -1 || epoll_ctl(epfd, EPOLL_CTL_ADD, efd, &ev) == -1)
+    {
+        LOG4CPLUS_ERROR(rpc_srv->errorLogger, "RPCServer::request_handler: eventfd error: " + std::string(strerror(errno)));
+    }
+
+    // 关闭连接；工作线程可能还持有该连接，因此在 write_lock 内关闭 fd，连接对象留在 slab 中
+    auto close_connection = [&](Connection &conn)
+    {
+        if (conn.closed)
+            return;
+        timers.cancel(conn.idle_timer);
+        epoll_ctl(epfd, EPOLL_CTL_DEL, conn.fd, NULL);
+        if (conn.shm)
+            epoll_ctl(epfd, EPOLL_CTL_DEL, conn.shm->req_event(), NULL);
+        rpc_srv->balancer.disconnected(slot);
+        rpc_srv->connections.fetch_sub(1, std::memory_order_relaxed);
+        {
+            std::lock_guard<std::mutex> lock(conn.write_lock);
+            conn.closed = true;
+            conn.output.clear(&buffers);
+            conn.shm.reset(); // 工作线程在 write_lock 内确认连接未关闭之后，才会访问共享内存
+            close(conn.fd);
+        }
+        conn.dirty = false;
+        conn.unread = false;
+    };
+
+    // 接收 acceptor 交来的新连接：取得（或复用）slab 中的连接对象，注册到 epoll，data.ptr 直接指向它
+    auto adopt = [&]()
+    {
+        std::pair<int, uint64_t> entry;
+        while (inbox.conns.pop(entry))
+        {
+            int fd = entry.first;
+            if (static_cast<size_t>(fd) >= slab.size())
+                slab.resize(std::max<size_t>(fd + 1, slab.size() * 2));
+            if (!slab[fd])
+                slab[fd].reset(new Connection(fd));
+            Connection &conn = *slab[fd];
+            {
+                // 之前的连接的工作线程可能还在完成响应，递增 generation 后，它们的响应会被丢弃
+                std::lock_guard<std::mutex> lock(conn.write_lock);
+                ++conn.generation;
+                conn.closed = false;
+                conn.notified.store(false, std::memory_order_relaxed);
+            }
+            conn.input.reset();
+            conn.unread = false;
+            conn.backlogged.store(false, std::memory_order_relaxed);
+            conn.inflight.store(0, std::memory_order_relaxed);
+            conn.drained.store(0, std::memory_order_relaxed);
+            conn.dirty = false;
+            conn.last_active = std::chrono::steady_clock::now();
+
+            ev.events = EPOLLIN | EPOLLOUT | EPOLLET;
+            ev.data.u64 = event_conn(&conn, entry.second);
+            if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) == -1)
+            {
+                LOG4CPLUS_ERROR(rpc_srv->errorLogger, "RPCServer::request_handler: epoll_ctl: EPOLL_CTL_ADD error: " + std::string(strerror(errno)));
+                close_connection(conn);
+                continue;
+            }
+            if (rpc_srv->idle_timeout.count() > 0)
+            {
+                conn.idle_timer.owner = &conn;
+                timers.schedule(conn.idle_timer, conn.last_active + rpc_srv->idle_timeout);
+            }
+        }
+    };
+
+    // 空闲定时器到期：收到数据、完成请求时只记录时间，不调整定时器，到期时再检查，仍然活跃则重新计时
+    auto reap = [&](TimerNode &node)
+    {
+        Connection &conn = *static_cast<Connection *>(node.owner);
+        auto now = std::chrono::steady_clock::now();
+        std::chrono::steady_clock::time_point drained(std::chrono::steady_clock::duration(conn.drained.load(std::memory_order_relaxed)));
+        auto deadline = std::max(conn.last_active, drained) + rpc_srv->idle_timeout;
+        if (deadline > now)
+            return timers.schedule(node, deadline);
+        // 还有请求未完成，或者响应还没写出（客户端可能只是读得慢），都不算空闲
+        if (conn.inflight.load(std::memory_order_relaxed) > 0 || conn.backlogged.load(std::memory_order_acquire) || conn.dirty)
+            return timers.schedule(node, now + rpc_srv->idle_timeout);
+        LOG4CPLUS_INFO(rpc_srv->logger, "Close idle connection, fd: " + std::to_string(conn.fd));
+        rpc_srv->idle_closed.fetch_add(1, std::memory_order_relaxed);
+        close_connection(conn);
+    };
+
+    // 写出 conn 的输出队列，调用者持有 conn.write_lock；出错时返回 false
+    auto write_output = [&](Connection &conn) -> bool
+    {
+        // 写之前先置位：如果在写的过程中 socket 由满变为可写，reactor 收到写事件时一定会加锁检查，不会遗漏
+        conn.backlogged.store(true, std::memory_order_release);
+        OutputQueue::Stats st;
+        OutputQueue::Status status = conn.output.writeTo(conn.fd, &buffers, &st);
+        rpc_srv->count(st);
+        // 发送缓冲区已满时，内核会在变为可写时产生写事件，reactor 收到后继续写出
+        conn.backlogged.store(status == OutputQueue::Status::AGAIN, std::memory_order_release);
+        return status != OutputQueue::Status::ERROR;
+    };
+
+    // 把输出队列中的响应写入共享内存的响应环，调用者持有 conn.write_lock
+    // 响应环已满时留在队列中，客户端读出后通过 req_event 唤醒 reactor 继续写入
+    auto flush_shm = [&buffers](Connection &conn)
+    {
+        SharedRing &ring = conn.shm->responses();
+        RingControl *ctrl = ring.control();
+        bool written = false;
+        iovec iov;
+        while (true)
+        {
+            while (conn.output.gather(&iov, 1) == 1 && ring.write(static_cast<const char *>(iov.iov_base), iov.iov_len))
+            {
+                conn.output.consume(iov.iov_len, &buffers);
+                written = true;
+            }
+            if (conn.output.empty() || ring.corrupted())
+                break;
+            // 先声明等待，再检查一次，避免客户端在此之间读完而遗漏通知
+            ctrl->producer_sleeping.store(1, std::memory_order_seq_cst);
+            if (!ring.writable(iov.iov_len))
+                break;
+        }
+        if (conn.output.empty())
+            ctrl->producer_sleeping.store(0, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst); // 写入 tail 与读取 consumer_sleeping 不能重排
+        if (written && ctrl->consumer_sleeping.load(std::memory_order_relaxed))
+            ShmRegion::notify(conn.shm->resp_event());
+    };
+
+    // 响应完成：输出队列为空时，工作线程直接写 socket；否则追加到输出队列，等待写事件
+    // 写合并时，交给 reactor 在本轮循环结束时统一写出；共享内存连接直接写入响应环
+    // gen 为分发请求时连接的 generation，不一致说明原来的连接已经关闭、连接对象已被复用
+    auto complete = [&buffers, &handoff, &signaled, efd, slot, corked, rpc_srv, write_output, flush_shm](Connection *conn, uint32_t gen, std::string &&resp_data)
+    {
+        rpc_srv->balancer.completed(slot);
+        {
+            std::lock_guard<std::mutex> lock(conn->write_lock);
+            if (conn->closed || conn->generation != gen)
+            {
+                buffers.release(std::move(resp_data));
+                return;
+            }
+            if (conn->inflight.fetch_sub(1, std::memory_order_relaxed) == 1 && rpc_srv->idle_timeout.count() > 0)
+                conn->drained.store(std::chrono::steady_clock::now().time_since_epoch().count(), std::memory_order_relaxed);
+            if (conn->shm)
+            {
+                conn->output.push(std::move(resp_data));
+                flush_shm(*conn);
+                if (conn->shm->responses().corrupted()) // 例如响应超过了环的大小，reactor 在控制连接的读事件中关闭连接
+                    shutdown(conn->fd, SHUT_RDWR);
+                return;
+            }
+            bool idle = conn->output.empty();
+            conn->output.push(std::move(resp_data)); // resp_data 已经包含了帧头
+            if (!corked)
+            {
+                if (idle && !write_output(*conn))
+                    conn->output.clear(&buffers); // 出错，reactor 会在读事件中关闭连接
+                return;
+            }
+            // 在 write_lock 内置位，连接对象被复用时 reactor 会清除，不会残留到新的连接
+            if (conn->notified.exchange(true, std::memory_order_acq_rel))
+                return;
+        }
+        handoff.push({conn, gen});
+        if (!signaled.exchange(true, std::memory_order_acq_rel))
+        {
+            uint64_t one = 1;
+            if (write(efd, &one, sizeof(one)) < 0)
+                LOG4CPLUS_ERROR(rpc_srv->errorLogger, "RPCServer::request_handler: eventfd write error: " + std::string(strerror(errno)));
+        }
+    };
+
+    // 写出待写出列表中的连接，每个连接一次 sendmsg；仍在写合并等待时间内的连接留在列表中
+    auto flush_dirty = [&]()
+    {
+        auto now = std::chrono::steady_clock::now();
+        size_t kept = 0;
+        for (Connection *conn : dirty)
+        {
+            if (!conn->dirty) // 已经关闭
+                continue;
+            std::unique_lock<std::mutex> lock(conn->write_lock);
+            if (now - conn->dirty_since < rpc_srv->cork_time && conn->output.pending() < rpc_srv->cork_bytes)
+            {
+                dirty[kept++] = conn;
+                continue;
+            }
+            conn->dirty = false;
+            conn->notified.store(false, std::memory_order_release); // 之后完成的响应需要重新交给 reactor
+            if (!write_output(*conn))
+            {
+                lock.unlock();
+                LOG4CPLUS_ERROR(rpc_srv->errorLogger, "RPCServer::request_handler: send error: " + std::string(strerror(errno)));
+                close_connection(*conn);
+            }
+        }
+        dirty.resize(kept);
+    };
+
+    // epoll_wait 最多等到最早的定时器到期；有连接在等待写合并时，最多等到最早的一个到期
+    auto wait_timeout = [&]() -> int
+    {
+        auto now = std::chrono::steady_clock::now();
+        if (!readable.empty()) // 还有连接没有读完，不等待
+            return 0;
+        int timeout = rpc_srv->epoll_wait_timeout;
+        int next = timers.timeout(now);
+        if (next >= 0 && (timeout < 0 || next < timeout))
+            timeout = next;
+        if (dirty.empty())
+            return timeout;
+        auto earliest = rpc_srv->cork_time;
+        for (Connection *conn : dirty)
+            earliest = std::min(earliest, std::chrono::duration_cast<std::chrono::microseconds>(conn->dirty_since + rpc_srv->cork_time - now));
+        if (earliest.count() <= 0)
+            return 0;
+        int64_t corked = (earliest.count() + 999) / 1000;
+        return timeout < 0 ? static_cast<int>(corked) : static_cast<int>(std::min<int64_t>(corked, timeout));
+    };
+
+    TaskQueue tq(rpc_srv->task_thread_nums, rpc_srv->queue_capacity, rpc_srv->overflow_policy, rpc_srv->admission); // 任务中引用了上面的局部变量，因此最后构造、最先析构
+    QueueGauge gauge(rpc_srv, tq);
+
+    // 把一个请求交给工作线程，同一连接上的多个请求由不同的工作线程并发执行
+    auto dispatch = [&](Connection *conn, std::string &&data)
+    {
+        int key = static_cast<int>(dispatched++ % rpc_srv->task_thread_nums);
+        conn->inflight.fetch_add(1, std::memory_order_relaxed);
+        rpc_srv->balancer.dispatched(slot);
+        // 收到请求的时间即连接最近一次收到数据的时间，不需要再读取时钟
+        // 队列已满时任务以 shed = true 在当前线程中调用，立即回复 OVERLOADED
+        tq.enqueue(key, [rpc_srv, conn, gen = conn->generation, arrival = conn->last_active, &buffers, &complete, data = std::move(data)](bool shed) mutable {
+            // 调用 rpc 服务，得到完整的响应帧，响应头中带有请求编号；已经超过期限的请求不再调用过程
+            std::string resp_data = buffers.acquire();
+            if (shed)
+                rpc_srv->shed(data, resp_data);
+            else
+                rpc_srv->serve(data, resp_data, arrival);
+            buffers.release(std::move(data));
+            complete(conn, gen, std::move(resp_data));
+        });
+    };
+
+    // 取出请求环中的请求交给工作线程，再写入积压的响应；与 socket 相同，最多读取 READ_BUDGET 个字节，读满时记入 readable，
+    // 下一轮循环继续读取（期间 consumer_sleeping 保持为 0，客户端不需要唤醒 reactor）。共享内存损坏时关闭连接，返回 false
+    auto serve_shm = [&](Connection *conn) -> bool
+    {
+        SharedRing &requests = conn->shm->requests();
+        RingControl *ctrl = requests.control();
+        ctrl->consumer_sleeping.store(0, std::memory_order_relaxed); // 处理期间，客户端写入请求时不需要唤醒 reactor
+        conn->last_active = std::chrono::steady_clock::now();
+        conn->unread = false;
+        size_t got = 0;
+        std::string buffer = buffers.acquire();
+        while (true)
+        {
+            while (got < READ_BUDGET && requests.read(buffer))
+            {
+                got += Frame::HEADER_SIZE + buffer.size();
+                dispatch(conn, std::move(buffer));
+                buffer = buffers.acquire();
+            }
+            if (requests.corrupted())
+                break;
+            if (got >= READ_BUDGET)
+            {
+                conn->unread = true;
+                readable.emplace_back(conn, conn->generation);
+                break;
+            }
+            // 先声明等待，再检查一次，避免客户端在此之间写入而遗漏通知
+            ctrl->consumer_sleeping.store(1, std::memory_order_seq_cst);
+            if (requests.empty())
+                break;
+            ctrl->consumer_sleeping.store(0, std::memory_order_relaxed);
+        }
+        buffers.release(std::move(buffer));
+        std::atomic_thread_fence(std::memory_order_seq_cst); // 写入 head 与读取 producer_sleeping 不能重排
+        if (ctrl->producer_sleeping.load(std::memory_order_relaxed)) // 客户端在等待请求环的空间
+            ShmRegion::notify(conn->shm->resp_event());
+
+        bool ok;
+        {
+            std::lock_guard<std::mutex> lock(conn->write_lock);
+            flush_shm(*conn);
+            ok = !requests.corrupted() && !conn->shm->responses().corrupted();
+        }
+        if (!ok)
+        {
+            LOG4CPLUS_ERROR(rpc_srv->errorLogger, "RPCServer::request_handler: shared memory is corrupted");
+            close_connection(*conn);
+        }
+        return ok;
+    };
+
+    // 共享内存连接的控制连接可读：第一次是客户端交来的共享内存，之后客户端不会再发送数据，只可能是已经退出
+    auto open_shm = [&](Connection *conn) -> bool
+    {
+        if (conn->shm)
+            return false;
+        std::unique_ptr<ShmRegion> region(new ShmRegion());
+        try
+        {
+            if (!region->accept(conn->fd))
+                return true;
+        }
+        catch (const std::exception &e)
+        {
+            LOG4CPLUS_ERROR(rpc_srv->errorLogger, "RPCServer::request_handler: shared memory error: " + std::string(e.what()));
+            return false;
+        }
+        epoll_event wake;
+        wake.events = EPOLLIN | EPOLLET;
+        wake.data.u64 = event_conn(conn, EVENT_SHM_WAKE);
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, region->req_event(), &wake) == -1)
+        {
+            LOG4CPLUS_ERROR(rpc_srv->errorLogger, "RPCServer::request_handler: epoll_ctl: EPOLL_CTL_ADD error: " + std::string(strerror(errno)));
+            return false;
+        }
+        {
+            std::lock_guard<std::mutex> lock(conn->write_lock);
+            conn->shm = std::move(region);
+        }
+        return serve_shm(conn); // 交来共享内存之前，客户端可能已经写入了请求
+    };
+
+    // 读取连接上的请求并分发，最多读取 READ_BUDGET 个字节：读满时记入 readable，下一轮循环继续读取，
+    // 期间先处理其它连接的事件，一个持续发送的连接不会独占 reactor，也不会在分发之前积压大量数据；连接被关闭时返回 false
+    auto read_input = [&](Connection *conn) -> bool
+    {
+        FrameDecoder &decoder = conn->input;
+        FrameDecoder::Status status = decoder.readFrom(conn->fd, READ_BUDGET);
+        conn->last_active = std::chrono::steady_clock::now();
+        if (status == FrameDecoder::Status::ERROR)
+        {
+            LOG4CPLUS_ERROR(rpc_srv->errorLogger, "RPCServer::request_handler: recv error: " + std::string(decoder.failed() ? "frame too large" : strerror(errno)));
+        }
+        if (status == FrameDecoder::Status::CLOSED || status == FrameDecoder::Status::ERROR) // 断开连接请求，或者出错
+        {
+            close_connection(*conn);
+            return false;
+        }
+
+        std::string buffer = buffers.acquire();
+        while (decoder.next(buffer))
+        {
+            // 添加请求到 TaskQueue
+            dispatch(conn, std::move(buffer));
+            buffer = buffers.acquire();
+        }
+        buffers.release(std::move(buffer));
+        if (decoder.failed())
+        {
+            LOG4CPLUS_ERROR(rpc_srv->errorLogger, "RPCServer::request_handler: recv error: frame too large");
+            close_connection(*conn);
+            return false;
+        }
+        conn->unread = status == FrameDecoder::Status::MORE;
+        if (conn->unread)
+            readable.emplace_back(conn, conn->generation);
+        return true;
+    };
 
     ++rpc_srv->active_reactors;
     while (true)
     {
-        int eventsNum = epoll_wait(epfd, events, rpc_srv->epoll_buffer_size, rpc_srv->epoll_wait_timeout);
+        int eventsNum = epoll_wait(epfd, events, rpc_srv->epoll_buffer_size, wait_timeout());
         if (eventsNum == -1)
         {
             LOG4CPLUS_ERROR(rpc_srv->errorLogger, "RPCServer::request_handler: epoll_wait error: " + std::string(strerror(errno)));
@@ -274,112 +1138,444 @@ void RPCServer::request_handler(RPCServer *rpc_srv, int epfd)
         // 如果需要退出
         if (rpc_srv->exited && eventsNum == 0)
             break;
+        reading.swap(readable); // 上一轮读满了 READ_BUDGET 的连接，在本轮的事件之后继续读取
 
         for (size_t i = 0; i < eventsNum; i++)
         {
-            int clnt_sock = events[i].data.fd;
-            // 读事件
-            if (events[i].events & EPOLLIN)
+            uint64_t data = events[i].data.u64;
+            uint64_t kind = data & EVENT_KIND_MASK;
+            if (kind == EVENT_FD)
             {
-                uint32_t msg_len;
-                ssize_t readSize;
-                readSize = recv(clnt_sock, reinterpret_cast<char *>(&msg_len), sizeof(msg_len), 0);
-
-                if (readSize <= 0)
+                int fd = static_cast<int>(data >> 2);
+                // 连接请求事件（reuse_port 模式），直接由当前 sub reactor 处理
+                if (fd != efd)
                 {
-                    if (readSize == 0) // 断开连接请求
-                    {
-                        epoll_ctl(epfd, EPOLL_CTL_DEL, clnt_sock, NULL);
-                        close(clnt_sock);
-                        {
-                            std::lock_guard<std::mutex> lock(rpc_srv->epfds_lock);
-                            --rpc_srv->epfds[epfd];
-                        }
-                        {
-                            std::lock_guard<std::mutex> lock(resp_lock);
-                            resp.erase(clnt_sock);
-                        }
-                    }
-                    else 
-                    {
-                        LOG4CPLUS_ERROR(rpc_srv->errorLogger, "RPCServer::request_handler: recv error: " + std::string(strerror(errno)));
-                    }
+                    rpc_srv->accept_connections(fd, epfd);
                     continue;
                 }
-                
-                msg_len = ntohl(msg_len);
-                std::string buffer(msg_len, '\0');
-                int remainingSize = msg_len;
-                int offset = 0;
-
-                while (remainingSize > 0)
+                // 工作线程交来的连接，加入待写出列表；acceptor 交来的新连接在本轮的最后处理
+                uint64_t value;
+                if (read(efd, &value, sizeof(value)) < 0 && errno != EAGAIN)
+                    LOG4CPLUS_ERROR(rpc_srv->errorLogger, "RPCServer::request_handler: eventfd read error: " + std::string(strerror(errno)));
+                signaled.exchange(false, std::memory_order_acq_rel); // 先清除标记，再取出，避免遗漏
+                inbox.signaled.exchange(false, std::memory_order_acq_rel);
+                std::pair<Connection *, uint32_t> entry;
+                while (handoff.pop(entry))
                 {
-                    int chunkSize = recv(clnt_sock, &buffer[offset], remainingSize, 0);
-                    if (chunkSize < 0)
-                    {
-                        LOG4CPLUS_ERROR(rpc_srv->errorLogger, "RPCServer::request_handler: recv error: " + std::string(strerror(errno)));
-                    }
-                    remainingSize -= chunkSize;
-                    offset += chunkSize;
+                    Connection *conn = entry.first;
+                    // closed、generation 只会在 reactor 线程中修改
+                    if (conn->generation != entry.second || conn->dirty || conn->closed)
+                        continue;
+                    conn->dirty = true;
+                    conn->dirty_since = std::chrono::steady_clock::now();
+                    dirty.push_back(conn);
                 }
+                continue;
+            }
+
+            // 同一轮中已经关闭的连接；连接对象只在本轮的最后才会被复用，因此这里不会是新的连接
+            Connection *conn = static_cast<Connection *>(reinterpret_cast<void *>(data & ~EVENT_KIND_MASK));
+            if (conn->closed)
+                continue;
 
-                // 添加请求到 TaskQueue
-                tq.enqueue(clnt_sock, [rpc_srv, epfd, clnt_sock](const std::string &data, std::unordered_map<int, std::string> &_resp, std::mutex &_resp_lock){
-                    // 调用 rpc 服务
-                    std::string resp_data = rpc_srv->framework.handleRequest(data);
-                    // std::string resp_data = "this is a resp, orignal data: " + data;
-                    // 将响应写入 resp 哈希表
-                    {
-                        std::lock_guard<std::mutex> lock(_resp_lock);
-                        _resp[clnt_sock] = resp_data;
-                    }
-                    // 注册写事件
-                    epoll_event ev;
-                    ev.data.fd = clnt_sock;
-                    ev.events = EPOLLOUT | EPOLLET;
-                    if (epoll_ctl(epfd, EPOLL_CTL_MOD, clnt_sock, &ev) == -1)
-                    {
-                        LOG4CPLUS_ERROR(rpc_srv->errorLogger, "RPCServer::request_handler: epoll_ctl: EPOLL_CTL_MOD error: " + std::string(strerror(errno)));
-                    }
-                }, buffer, std::ref(resp), std::ref(resp_lock));
+            // 共享内存连接的客户端写入了请求，或者读出了响应（响应环有了空间）；等待继续读取（unread）的连接留到本轮的最后处理
+            if (kind == EVENT_SHM_WAKE)
+            {
+                ShmRegion::drain(conn->shm->req_event());
+                if (!conn->unread)
+                    serve_shm(conn);
+                continue;
             }
-            // 写事件
-            else if (events[i].events & EPOLLOUT)
+            if (kind == EVENT_SHM_CONTROL)
             {
-                std::string resp_data;
-                {
-                    std::lock_guard<std::mutex> lock(resp_lock);
-                    try
-                    {
-                        resp_data = resp.at(clnt_sock);
-                    }
-                    catch(const std::exception& e)
-                    {
-                        std::cout << "get resp error: " << e.what() << "\n";
-                        LOG4CPLUS_ERROR(rpc_srv->errorLogger, "RPCServer::request_handler: get resp from resp_mapping error: " + std::string(e.what()));
-                    }
-                }
+                if ((events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) && !open_shm(conn))
+                    close_connection(*conn);
+                continue;
+            }
 
-                // 构造消息头，包含数据包的长度信息
-                uint32_t msg_len = htonl(resp_data.size());
-                // 将 msg_len 强转，封装在消息头部
-                std::string packet = std::string(reinterpret_cast<const char *>(&msg_len), sizeof(msg_len)) + resp_data;
-                // 响应执行结果                
-                int sendSize = send(clnt_sock, packet.data(), packet.size(), 0);
-                if (sendSize < 0)
+            // 读事件；边缘触发，需要一直读到 EAGAIN，不完整的帧留在 decoder 中等待下一次读事件
+            // 已经在等待继续读取（unread）的连接，留到本轮的最后读取
+            if ((events[i].events & EPOLLIN) && !conn->unread && !read_input(conn))
+                continue;
+            // 写事件，与读事件可能同时发生；只有之前写到 EAGAIN 时，才需要继续写出
+            if ((events[i].events & EPOLLOUT) && conn->backlogged.load(std::memory_order_acquire))
+            {
+                std::unique_lock<std::mutex> lock(conn->write_lock);
+                if (!write_output(*conn))
                 {
+                    lock.unlock();
                     LOG4CPLUS_ERROR(rpc_srv->errorLogger, "RPCServer::request_handler: send error: " + std::string(strerror(errno)));
+                    close_connection(*conn);
+                    continue;
                 }
+            }
+        }
 
-                // 注册读事件
-                ev.data.fd = clnt_sock;
-                ev.events = EPOLLIN | EPOLLET;
-                if (epoll_ctl(epfd, EPOLL_CTL_MOD, clnt_sock, &ev) == -1)
-                {
-                    LOG4CPLUS_ERROR(rpc_srv->errorLogger, "RPCServer::request_handler: epoll_ctl: EPOLL_CTL_MOD error: " + std::string(strerror(errno)));
-                }
+        for (auto &entry : reading)
+        {
+            Connection *conn = entry.first;
+            // 之后已经读完、关闭，或者连接对象已被复用
+            if (conn->generation == entry.second && conn->unread && !conn->closed)
+            {
+                if (conn->shm)
+                    serve_shm(conn);
+                else
+                    read_input(conn);
+            }
+        }
+        reading.clear();
+
+        flush_dirty();
+        timers.advance(std::chrono::steady_clock::now(), reap);
+        adopt(); // 放在最后：本轮中关闭的连接对象，不会在本轮剩余的事件中被新的连接复用
+    }
+    --rpc_srv->active_reactors;
+}
+
+void RPCServer::uring_handler(RPCServer *rpc_srv, IOUring *ring, int listen_fd)
+{
+    // user_data 的高 32 位为请求的类型，低 32 位为 fd；连接的所有请求完成之前不会关闭 fd，因此 fd 不会被复用
+    enum : uint64_t {OP_ACCEPT = 1, OP_RECV, OP_SEND, OP_WAKE, OP_CANCEL};
+    auto tag = [](uint64_t op, int fd) -> uint64_t
+    {return op << 32 | static_cast<uint32_t>(fd);};
+
+    std::unique_ptr<BufferRing> inputs; // recv 使用的缓冲区，由内核在数据到达时选择
+    try
+    {
+        ring->enable();
+        inputs.reset(new BufferRing(*ring, 0, URING_BUFFERS, URING_BUFFER_SIZE));
+    }
+    catch (const std::exception &e)
+    {
+        LOG4CPLUS_ERROR(rpc_srv->errorLogger, "RPCServer::uring_handler: " + std::string(e.what()));
+        return;
+    }
+
+    BufferPool buffers; // 请求、响应缓冲区的容量在该 reactor 内循环使用，需要先于 tq 构造、后于 tq 析构
+    MPSCQueue<std::shared_ptr<Connection>> handoff; // 工作线程交给 reactor 写出的连接
+    std::atomic<bool> signaled{false}; // eventfd 已经写入、reactor 还未处理
+    int efd = eventfd(0, EFD_CLOEXEC); // 工作线程通知 reactor，由 io_uring 读取
+    uint64_t wakeups = 0;              // eventfd 的读缓冲区
+    size_t dispatched = 0; // 已分发的请求数，用于将同一连接的请求轮流分发给不同的工作线程
+    std::unordered_map<int, std::shared_ptr<Connection>> conns; // 只在 reactor 线程中访问
+    const size_t slot = rpc_srv->balancer.index(ring->fd()); // 在 balancer 中记录活跃连接数、进行中的请求数
+    size_t outstanding = 0; // 已提交、还未收到最后一个 cqe 的请求数，退出前需要等到它为 0
+
+    if (efd == -1)
+    {
+        LOG4CPLUS_ERROR(rpc_srv->errorLogger, "RPCServer::uring_handler: eventfd error: " + std::string(strerror(errno)));
+        return;
+    }
+
+    auto get_sqe = [&](uint64_t user_data) -> io_uring_sqe *
+    {
+        io_uring_sqe *sqe = ring->get_sqe();
+        if (sqe == nullptr)
+            LOG4CPLUS_ERROR(rpc_srv->errorLogger, "RPCServer::uring_handler: submission queue is full: " + std::string(strerror(errno)));
+        else
+        {
+            sqe->user_data = user_data;
+            ++outstanding;
+        }
+        return sqe;
+    };
+
+    auto arm_accept = [&](int fd)
+    {
+        if (io_uring_sqe *sqe = get_sqe(tag(OP_ACCEPT, fd)))
+            IOUring::prep_accept_multishot(sqe, fd, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    };
+
+    auto arm_recv = [&](Connection &conn)
+    {
+        if (io_uring_sqe *sqe = get_sqe(tag(OP_RECV, conn.fd)))
+        {
+            IOUring::prep_recv_multishot(sqe, conn.fd, inputs->group());
+            conn.receiving = true;
+        }
+    };
+
+    auto arm_wake = [&]()
+    {
+        if (io_uring_sqe *sqe = get_sqe(tag(OP_WAKE, efd)))
+            IOUring::prep_read(sqe, efd, &wakeups, sizeof(wakeups));
+    };
+
+    // 所有请求都已完成后，才真正关闭 fd，清理连接的状态
+    auto release_connection = [&](Connection &conn)
+    {
+        if (!conn.closed || conn.receiving || conn.sending > 0 || conn.released)
+            return;
+        conn.released = true;
+        {
+            std::lock_guard<std::mutex> lock(conn.write_lock);
+            conn.output.clear(&buffers);
+            close(conn.fd);
+        }
+        rpc_srv->balancer.disconnected(slot);
+        rpc_srv->connections.fetch_sub(1, std::memory_order_relaxed);
+        conns.erase(conn.fd); // conn 随之析构，之后不能再访问
+    };
+
+    // 关闭连接：shutdown 使进行中的 recv、sendmsg 尽快完成，全部完成后再 release_connection
+    auto close_connection = [&](Connection &conn)
+    {
+        if (conn.closed)
+            return;
+        {
+            std::lock_guard<std::mutex> lock(conn.write_lock);
+            conn.closed = true;
+        }
+        shutdown(conn.fd, SHUT_RDWR);
+        release_connection(conn);
+    };
+
+    // 提交 conn 的输出队列，分成若干个链接的 sendmsg，按顺序执行；上一批全部完成后，才提交下一批
+    auto submit_send = [&](Connection &conn)
+    {
+        if (conn.closed || conn.sending > 0)
+            return;
+        std::lock_guard<std::mutex> lock(conn.write_lock);
+        size_t cnt = std::min(conn.output.count(), OutputQueue::MAX_IOV * URING_SEND_LINKS);
+        if (cnt == 0)
+            return;
+        conn.iov.resize(cnt);
+        cnt = conn.output.gather(conn.iov.data(), cnt);
+        size_t links = (cnt + OutputQueue::MAX_IOV - 1) / OutputQueue::MAX_IOV;
+        conn.msgs.assign(links, msghdr{});
+        // 一条链需要在同一次提交中完成，否则会被拆成两条，不再保证顺序
+        if (ring->space() < links)
+            ring->submit();
+        for (size_t i = 0; i < links; i++)
+        {
+            io_uring_sqe *sqe = get_sqe(tag(OP_SEND, conn.fd));
+            if (sqe == nullptr)
+                break;
+            conn.msgs[i].msg_iov = &conn.iov[i * OutputQueue::MAX_IOV];
+            conn.msgs[i].msg_iovlen = std::min(OutputQueue::MAX_IOV, cnt - i * OutputQueue::MAX_IOV);
+            // MSG_WAITALL：发送缓冲区满时由内核等待并继续发送，而不是返回部分写入
+            IOUring::prep_sendmsg(sqe, conn.fd, &conn.msgs[i], MSG_NOSIGNAL | MSG_WAITALL);
+            if (i + 1 < links)
+                sqe->flags |= IOSQE_IO_LINK;
+            ++conn.sending;
+        }
+    };
+
+    // 响应完成：追加到输出队列，交给 reactor 写出，工作线程不写 socket
+    auto complete = [&buffers, &handoff, &signaled, efd, slot, rpc_srv](const std::shared_ptr<Connection> &conn, std::string &&resp_data)
+    {
+        rpc_srv->balancer.completed(slot);
+        {
+            std::lock_guard<std::mutex> lock(conn->write_lock);
+            if (conn->closed)
+            {
+                buffers.release(std::move(resp_data));
+                return;
             }
+            conn->output.push(std::move(resp_data)); // resp_data 已经包含了帧头
+        }
+        if (conn->notified.exchange(true, std::memory_order_acq_rel))
+            return;
+        handoff.push(conn);
+        if (!signaled.exchange(true, std::memory_order_acq_rel))
+        {
+            uint64_t one = 1;
+            if (write(efd, &one, sizeof(one)) < 0)
+                LOG4CPLUS_ERROR(rpc_srv->errorLogger, "RPCServer::uring_handler: eventfd write error: " + std::string(strerror(errno)));
+        }
+    };
+
+    TaskQueue tq(rpc_srv->task_thread_nums, rpc_srv->queue_capacity, rpc_srv->overflow_policy, rpc_srv->admission); // 任务中引用了上面的局部变量，因此最后构造、最先析构
+    QueueGauge gauge(rpc_srv, tq);
+
+    // 取出 conn 中所有完整的请求帧，交给工作线程
+    auto dispatch = [&](const std::shared_ptr<Connection> &conn)
+    {
+        std::string buffer = buffers.acquire();
+        auto arrival = std::chrono::steady_clock::now();
+        while (conn->input.next(buffer))
+        {
+            int worker = static_cast<int>(dispatched++ % rpc_srv->task_thread_nums);
+            rpc_srv->balancer.dispatched(slot);
+            tq.enqueue(worker, [rpc_srv, conn, arrival, &buffers, &complete, data = std::move(buffer)](bool shed) mutable {
+                // 调用 rpc 服务，得到完整的响应帧，响应头中带有请求编号；已经超过期限的请求不再调用过程
+                std::string resp_data = buffers.acquire();
+                if (shed)
+                    rpc_srv->shed(data, resp_data);
+                else
+                    rpc_srv->serve(data, resp_data, arrival);
+                buffers.release(std::move(data));
+                complete(conn, std::move(resp_data));
+            });
+            buffer = buffers.acquire();
         }
+        buffers.release(std::move(buffer));
+    };
+
+    auto on_accept = [&](const io_uring_cqe &cqe, int fd)
+    {
+        if (!(cqe.flags & IORING_CQE_F_MORE) && !rpc_srv->exited)
+            arm_accept(fd); // multishot accept 已经结束（例如出错），重新发起
+        if (cqe.res < 0)
+        {
+            int err = -cqe.res;
+            if ((err == EMFILE || err == ENFILE) && rpc_srv->shed_connection(fd))
+                return;
+            if (err != EAGAIN && err != ECONNABORTED && err != EINTR)
+                LOG4CPLUS_ERROR(rpc_srv->errorLogger, "RPCServer::uring_handler: accept error: " + std::string(strerror(err)));
+            return;
+        }
+        int clnt_sock = cqe.res;
+        if (!rpc_srv->admit_connection(clnt_sock))
+            return;
+        rpc_srv->balancer.connected(slot);
+        auto conn = std::make_shared<Connection>(clnt_sock);
+        conns.emplace(clnt_sock, conn);
+        arm_recv(*conn);
+    };
+
+    auto on_recv = [&](const io_uring_cqe &cqe, int fd)
+    {
+        auto it = conns.find(fd);
+        bool buffered = cqe.flags & IORING_CQE_F_BUFFER;
+        uint16_t bid = static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+        if (it == conns.end())
+        {
+            if (buffered)
+                inputs->recycle(bid);
+            return;
+        }
+        std::shared_ptr<Connection> conn = it->second;
+        if (!(cqe.flags & IORING_CQE_F_MORE))
+            conn->receiving = false;
+
+        if (cqe.res > 0 && buffered)
+        {
+            bool ok = conn->closed || conn->input.feed(inputs->data(bid), cqe.res);
+            inputs->recycle(bid);
+            if (!ok)
+            {
+                LOG4CPLUS_ERROR(rpc_srv->errorLogger, "RPCServer::uring_handler: recv error: frame too large");
+                close_connection(*conn);
+            }
+            else if (!conn->closed)
+                dispatch(conn);
+        }
+        else if (cqe.res == 0) // 断开连接请求
+            close_connection(*conn);
+        else if (cqe.res != -ENOBUFS) // 缓冲区暂时用完时，重新发起 recv 即可
+        {
+            if (!conn->closed)
+                LOG4CPLUS_ERROR(rpc_srv->errorLogger, "RPCServer::uring_handler: recv error: " + std::string(strerror(-cqe.res)));
+            close_connection(*conn);
+        }
+
+        if (!conn->receiving && !conn->closed)
+            arm_recv(*conn);
+        release_connection(*conn);
+    };
+
+    auto on_send = [&](const io_uring_cqe &cqe, int fd)
+    {
+        auto it = conns.find(fd);
+        if (it == conns.end())
+            return;
+        std::shared_ptr<Connection> conn = it->second;
+        --conn->sending;
+        if (cqe.res >= 0)
+        {
+            OutputQueue::Stats st;
+            {
+                std::lock_guard<std::mutex> lock(conn->write_lock);
+                conn->output.consume(cqe.res, &buffers, &st);
+            }
+            rpc_srv->count(st);
+        }
+        else if (cqe.res != -ECANCELED) // 链中前一个 sendmsg 没有完整写出，之后的被取消，剩余的数据重新提交
+        {
+            if (!conn->closed)
+                LOG4CPLUS_ERROR(rpc_srv->errorLogger, "RPCServer::uring_handler: send error: " + std::string(strerror(-cqe.res)));
+            close_connection(*conn);
+        }
+        if (conn->sending == 0)
+            submit_send(*conn); // 期间完成的响应，或者没有写完的部分
+        release_connection(*conn);
+    };
+
+    auto on_wake = [&]()
+    {
+        signaled.exchange(false, std::memory_order_acq_rel); // 先清除标记，再取出，避免遗漏
+        std::shared_ptr<Connection> conn;
+        while (handoff.pop(conn))
+        {
+            conn->notified.store(false, std::memory_order_release); // 之后完成的响应需要重新交给 reactor
+            submit_send(*conn);
+        }
+        arm_wake();
+    };
+
+    arm_wake();
+    arm_accept(listen_fd);
+    if (rpc_srv->unix_fd != -1)
+        arm_accept(rpc_srv->unix_fd);
+    ++rpc_srv->active_reactors;
+    while (true)
+    {
+        // 一次系统调用完成提交与等待
+        if (ring->submit_and_wait(rpc_srv->epoll_wait_timeout) < 0)
+            LOG4CPLUS_ERROR(rpc_srv->errorLogger, "RPCServer::uring_handler: io_uring_enter error: " + std::string(strerror(errno)));
+
+        unsigned completed = ring->for_each_cqe([&](const io_uring_cqe &cqe)
+        {
+            if (!(cqe.flags & IORING_CQE_F_MORE)) // multishot 请求在最后一个 cqe 时结束
+                --outstanding;
+            int fd = static_cast<int>(cqe.user_data & 0xffffffff);
+            switch (cqe.user_data >> 32)
+            {
+            case OP_ACCEPT:
+                on_accept(cqe, fd);
+                break;
+            case OP_RECV:
+                on_recv(cqe, fd);
+                break;
+            case OP_SEND:
+                on_send(cqe, fd);
+                break;
+            case OP_WAKE:
+                on_wake();
+                break;
+            }
+        });
+        // 如果需要退出
+        if (rpc_srv->exited && completed == 0)
+            break;
     }
+
+    // 仍在进行的 accept、recv、sendmsg 与 eventfd 的读引用了 inputs、conns 中的 msghdr/iovec、wakeups 等局部变量，
+    // ring 比本函数存活更久：取消所有请求，收割到它们全部结束之后才能返回，否则内核可能写入已经释放的内存
+    for (auto &entry : conns)
+        shutdown(entry.first, SHUT_RDWR);
+    bool cancel = true;
+    while (outstanding > 0)
+    {
+        if (cancel)
+        {
+            if (io_uring_sqe *sqe = get_sqe(tag(OP_CANCEL, 0)))
+                IOUring::prep_cancel_all(sqe);
+        }
+        if (ring->submit_and_wait(rpc_srv->epoll_wait_timeout) < 0)
+            LOG4CPLUS_ERROR(rpc_srv->errorLogger, "RPCServer::uring_handler: io_uring_enter error: " + std::string(strerror(errno)));
+        unsigned completed = ring->for_each_cqe([&](const io_uring_cqe &cqe)
+        {
+            if (!(cqe.flags & IORING_CQE_F_MORE))
+                --outstanding;
+            if (cqe.flags & IORING_CQE_F_BUFFER)
+                inputs->recycle(static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT));
+        });
+        cancel = completed == 0; // 之前的取消之后仍有请求没有结束（例如在取消之后才开始），再取消一次
+    }
+    for (auto &entry : conns)
+        close(entry.first);
+    close(efd);
     --rpc_srv->active_reactors;
-}
\ No newline at end of file
+}
@@ -17,6 +17,28 @@ struct RetType<void>
     typedef int type;
 };
 
+// 响应头，位于帧头之后、ReturnPacket 之前，内容为对应请求的编号（定长 4 字节，小端序）
+// 定长且不受编码方式影响，客户端不需要知道返回值的类型，就可以将响应分发给对应的请求
+struct ResponseHeader
+{
+    static constexpr size_t SIZE = sizeof(uint32_t);
+
+    // 将 seq 追加到 buf 的末尾
+    static void write(std::string &buf, uint32_t seq)
+    {
+        for (size_t i = 0; i < SIZE; i++)
+            buf.push_back(static_cast<char>(seq >> (8 * i)));
+    }
+
+    static uint32_t read(const char *data)
+    {
+        uint32_t seq = 0;
+        for (size_t i = 0; i < SIZE; i++)
+            seq |= static_cast<uint32_t>(static_cast<unsigned char>(data[i])) << (8 * i);
+        return seq;
+    }
+};
+
 template <typename R>
 class ReturnPacket : public Serializable
 {
@@ -27,29 +49,34 @@ public:
     static constexpr code_t SUCCESS = 0;
     static constexpr code_t UNKNOWN = 1;    
     static constexpr code_t NO_SUCH_PROCEDURE = 2;
+    static constexpr code_t DEADLINE_EXCEEDED = 3; // 在工作线程处理之前已经超时，没有调用过程
+    static constexpr code_t OVERLOADED = 4;        // 服务端的任务队列已满，没有调用过程，客户端应当稍后重试
 
+    // 返回值直接写入 os，不再经过临时字符串：先预留 4 字节的长度，写完返回值后回填
     template <typename X>
     static std::ostream& Serialize(std::ostream &os, const ReturnPacket<X> &retPack)
     {
-        std::string temp = Serializer::Serialize(retPack.ret);
-        os << retPack.code << " " << temp.size() << " " << temp;
+        Serializable::Serialize(os, retPack.code);
+        auto lenPos = os.tellp();
+        Serializable::writeRaw(os, uint32_t(0));
+        Serializable::Serialize(os, retPack.ret);
+        auto endPos = os.tellp();
+        os.seekp(lenPos);
+        Serializable::writeRaw(os, static_cast<uint32_t>(endPos - lenPos - sizeof(uint32_t)));
+        os.seekp(endPos);
         return os;
     }
 
     template <typename X>
     static std::istream& DeSerialize(std::istream &is, ReturnPacket<X> &retPack)
     {
-        size_t len;
-        std::string temp;
-        is >> retPack.code >> len;
-        is.seekg(1, std::ios::cur);
-
-        char *buffer = new char[len + 1];
-        is.read(buffer, len);
-        buffer[len] = '\0';
-        temp = buffer;
-
-        retPack.ret = Serializer::Deserialize<typename RetType<R>::type>(temp);
+        uint32_t len;
+        Serializable::DeSerialize(is, retPack.code);
+        Serializable::readRaw(is, len); // 返回值直接从 is 中解析，长度仅用于定界
+        if (retPack.code != SUCCESS) // 出错时，返回值的类型与期望的不一定相同，直接跳过
+            is.ignore(len);
+        else
+            Serializable::DeSerialize(is, retPack.ret);
         return is;
     }
 
@@ -88,5 +115,5 @@ public:
 
 private:
     code_t code;
-    ret_t ret;
+    ret_t ret{}; // 出错时不会被赋值，值初始化，避免把未初始化的内存发给客户端
 };
\ No newline at end of file
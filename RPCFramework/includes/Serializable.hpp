@@ -2,6 +2,11 @@
 
 #include <iostream>
 #include <string>
+#include <string_view>
+#include <stdexcept>
+#include <cstring>
+#include <cstdint>
+#include <type_traits>
 #include <vector>
 #include <list>
 #include <array>
@@ -11,6 +16,11 @@
 #include <unordered_set>
 #include <stack>
 #include <queue>
+#include <algorithm>
+#if __cplusplus >= 202002L
+#include <span>
+#endif
+#include "Buffer.hpp"
 
 class Serializable;
 
@@ -22,9 +32,38 @@ struct is_serializable
     static constexpr bool value = std::is_base_of_v<Serializable, T>;
 };
 
+// 编码方式，同一次调用中，请求与响应使用相同的编码方式
+enum class Codec : char
+{
+    TEXT = 'T',     // 文本编码，标量通过 << 与 >> 格式化，以空格分隔
+    BINARY = 'B',   // 二进制编码，标量使用定长小端序，字符串与容器带长度前缀
+    VARINT = 'V',   // 在 BINARY 的基础上，整数（包括长度前缀）使用 LEB128 变长编码，有符号数先做 zigzag 变换
+};
+
 class Serializable
 {
 public:
+    // 默认编码方式，编译时定义 RPC_TEXT_CODEC 可以切换回文本编码，定义 RPC_VARINT_CODEC 可以切换为变长整数编码
+#if defined(RPC_TEXT_CODEC)
+    static constexpr Codec DEFAULT_CODEC = Codec::TEXT;
+#elif defined(RPC_VARINT_CODEC)
+    static constexpr Codec DEFAULT_CODEC = Codec::VARINT;
+#else
+    static constexpr Codec DEFAULT_CODEC = Codec::BINARY;
+#endif
+
+    // 获取流当前使用的编码方式，未设置过的流使用 DEFAULT_CODEC
+    static Codec getCodec(std::ios_base &s);
+
+    // 设置流使用的编码方式，之后所有 Serialize/DeSerialize 均按该方式编解码
+    static void setCodec(std::ios_base &s, Codec codec);
+
+    // 检查 tag 是否为合法的编码方式
+    static bool vaildCodec(char tag);
+
+    // 是否为二进制编码（BINARY 或 VARINT）
+    static bool isBinary(Codec codec);
+
     template <typename T>
     static
     std::ostream& Serialize(std::ostream &os, const T &val);
@@ -39,6 +78,24 @@ public:
     static
     std::istream& DeSerialize(std::istream &is, std::string &val);
 
+    static
+    std::ostream& Serialize(std::ostream &os, std::string_view val);
+
+    // 零拷贝，val 直接指向 ViewBuffer 引用的内存，因此只能从 ViewBuffer 中反序列化
+    static
+    std::istream& DeSerialize(std::istream &is, std::string_view &val);
+
+#if __cplusplus >= 202002L
+    template <typename T>
+    static
+    std::ostream& Serialize(std::ostream &os, std::span<const T> val);
+
+    // 零拷贝，要求 T 在当前编码方式下可以整块拷贝，且数据满足 T 的对齐要求
+    template <typename T>
+    static
+    std::istream& DeSerialize(std::istream &is, std::span<const T> &val);
+#endif
+
     template <typename T>
     static
     std::ostream& Serialize(std::ostream &os, const std::vector<T> &val);
@@ -126,8 +183,224 @@ public:
     template <typename Tp, typename Sequence, typename Compare>
     static
     std::istream& DeSerialize(std::istream &is, std::priority_queue<Tp, Sequence, Compare> &val);
+
+    // 以定长小端序写入标量，不受编码方式影响
+    template <typename T>
+    static void writeRaw(std::ostream &os, const T &val);
+
+    // 以定长小端序读取标量，不受编码方式影响
+    template <typename T>
+    static void readRaw(std::istream &is, T &val);
+
+private:
+    static int codecIndex();
+
+    // 读取字符串、视图的长度前缀
+    static size_t readLength(std::istream &is);
+
+    // 获取 is 底层的 ViewBuffer，用于零拷贝反序列化
+    static ViewBuffer *viewOf(std::istream &is);
+
+    // is 中剩余未读取的字节数，用于在分配空间之前检查对端发来的长度
+    static size_t remainingOf(std::istream &is);
+
+    // 读取容器的元素个数：来自对端，每个元素至少占 1 个字节，超过剩余的数据时使 is 失败，返回 false
+    static bool readCount(std::istream &is, size_t &size);
+
+    // 元素类型为 T 的连续内存，在编码方式 codec 下能否整块拷贝
+    template <typename T>
+    static bool bulkCopyable(Codec codec);
+
+    // LEB128 编码，每个字节低 7 位存放数据，最高位表示后面是否还有字节
+    static void writeVarint(std::ostream &os, uint64_t val);
+
+    static uint64_t readVarint(std::istream &is);
 };
 
+// 辅助模版，二进制编码下，可以直接按字节写入的标量类型
+template <typename T>
+struct is_raw_scalar
+{
+    static constexpr bool value = std::is_arithmetic_v<T> || std::is_enum_v<T>;
+};
+
+// 辅助模版，VARINT 编码下，使用变长编码的整数类型（单字节类型与 bool 直接写入）
+template <typename T>
+struct is_varint_integral
+{
+    static constexpr bool value = std::is_integral_v<T> && !std::is_same_v<T, bool> && (sizeof(T) > 1);
+};
+
+// 主机字节序是否为小端序
+constexpr bool host_little_endian = __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__;
+
+// 辅助模版，用于标记可以按内存布局整块拷贝的自定义 POD 类型，通过 RPC_POD_SERIALIZABLE 特例化
+// 注意：通信双方的结构体布局（对齐、字节序）必须一致
+template <typename T>
+struct is_pod_serializable
+{
+    static constexpr bool value = false;
+};
+
+// 声明 Type 为 POD 类型，无需手写 Serialize 和 DeSerialize，须在全局命名空间中使用
+#define RPC_POD_SERIALIZABLE(Type)                                                              \
+    template <>                                                                                 \
+    struct is_pod_serializable<Type>                                                            \
+    {                                                                                           \
+        static_assert(std::is_trivially_copyable_v<Type>, #Type " is not trivially copyable"); \
+        static constexpr bool value = true;                                                     \
+    }
+
+// 辅助模版，元素在二进制编码下的表示与其内存布局完全相同，容器可以使用一次 memcpy 完成编解码
+// vector<bool> 不是连续存储的，因此排除 bool
+template <typename T>
+struct is_bulk_copyable
+{
+    static constexpr bool value = std::is_trivially_copyable_v<T> && 
+                                  ((std::is_arithmetic_v<T> && !std::is_same_v<T, bool>) || std::is_enum_v<T> || is_pod_serializable<T>::value);
+};
+
+inline int Serializable::codecIndex()
+{
+    static const int index = std::ios_base::xalloc();
+    return index;
+}
+
+inline Codec Serializable::getCodec(std::ios_base &s)
+{
+    long tag = s.iword(codecIndex());
+    return tag == 0 ? DEFAULT_CODEC : static_cast<Codec>(tag);
+}
+
+inline void Serializable::setCodec(std::ios_base &s, Codec codec)
+{
+    s.iword(codecIndex()) = static_cast<long>(codec);
+}
+
+inline bool Serializable::vaildCodec(char tag)
+{
+    return tag == static_cast<char>(Codec::TEXT) || tag == static_cast<char>(Codec::BINARY) || 
+           tag == static_cast<char>(Codec::VARINT);
+}
+
+inline bool Serializable::isBinary(Codec codec)
+{
+    return codec != Codec::TEXT;
+}
+
+inline size_t Serializable::readLength(std::istream &is)
+{
+    size_t len = 0;
+    if (isBinary(getCodec(is)))
+        Serializable::DeSerialize(is, len);
+    else
+    {
+        is >> len;
+        is.seekg(1, std::ios::cur); // 跳过空格
+    }
+    return len;
+}
+
+inline ViewBuffer *Serializable::viewOf(std::istream &is)
+{
+    ViewBuffer *view = dynamic_cast<ViewBuffer *>(is.rdbuf());
+    if (view == nullptr)
+        throw std::runtime_error("Serializable: zero-copy deserialization requires a ViewBuffer");
+    return view;
+}
+
+inline size_t Serializable::remainingOf(std::istream &is)
+{
+    if (ViewBuffer *view = dynamic_cast<ViewBuffer *>(is.rdbuf()))
+        return view->remaining();
+    // 其它的流通过定位得到剩余的长度
+    std::streampos pos = is.tellg();
+    if (pos == std::streampos(-1))
+        throw std::runtime_error("Serializable: can not determine the remaining length of the stream");
+    is.seekg(0, std::ios::end);
+    std::streampos end = is.tellg();
+    is.seekg(pos);
+    return end > pos ? static_cast<size_t>(end - pos) : 0;
+}
+
+inline bool Serializable::readCount(std::istream &is, size_t &size)
+{
+    Serializable::DeSerialize(is, size);
+    if (!is)
+        return false;
+    if (size > remainingOf(is))
+    {
+        is.setstate(std::ios::failbit);
+        return false;
+    }
+    return true;
+}
+
+inline void Serializable::writeVarint(std::ostream &os, uint64_t val)
+{
+    char bytes[10]; // uint64_t 最多需要 10 个字节
+    int len = 0;
+    while (val >= 0x80)
+    {
+        bytes[len++] = static_cast<char>((val & 0x7f) | 0x80);
+        val >>= 7;
+    }
+    bytes[len++] = static_cast<char>(val);
+    os.write(bytes, len);
+}
+
+inline uint64_t Serializable::readVarint(std::istream &is)
+{
+    uint64_t val = 0;
+    for (int shift = 0; shift < 64; shift += 7)
+    {
+        int byte = is.get();
+        if (byte == std::char_traits<char>::eof())
+            break;
+        val |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+            return val;
+    }
+    is.setstate(std::ios::failbit); // 数据被截断，或超过 10 个字节
+    return 0;
+}
+
+template <typename T>
+bool Serializable::bulkCopyable(Codec codec)
+{
+    if constexpr (!is_bulk_copyable<T>::value || !host_little_endian)
+        return false;
+    else if constexpr (is_varint_integral<T>::value)
+        return codec == Codec::BINARY; // VARINT 编码下，整数需要逐个变长编码
+    else
+        return isBinary(codec);
+}
+
+template <typename T>
+void Serializable::writeRaw(std::ostream &os, const T &val)
+{
+    char bytes[sizeof(T)];
+    std::memcpy(bytes, &val, sizeof(T));
+    if constexpr (!host_little_endian)
+        std::reverse(bytes, bytes + sizeof(T));
+    os.write(bytes, sizeof(T));
+}
+
+template <typename T>
+void Serializable::readRaw(std::istream &is, T &val)
+{
+    char bytes[sizeof(T)];
+    is.read(bytes, sizeof(T));
+    if (is.gcount() != static_cast<std::streamsize>(sizeof(T))) // 数据被截断，流已经失败，不能使用未读入的字节
+    {
+        val = T();
+        return;
+    }
+    if constexpr (!host_little_endian)
+        std::reverse(bytes, bytes + sizeof(T));
+    std::memcpy(&val, bytes, sizeof(T));
+}
+
 // 大部分容器都可以使用该序列化方式
 template <typename T>
 std::ostream& helper(std::ostream &os, const T &val);
@@ -138,6 +411,36 @@ std::ostream& Serializable::Serialize(std::ostream &os, const T &val)
 {
     if constexpr (is_serializable<T>::value) // 如果对象继承自 Serializable，就使用自己的序列化方法
         return T::Serialize(os, val);
+    else if constexpr (is_pod_serializable<T>::value) // POD 类型，直接写入内存布局
+    {
+        if (!isBinary(getCodec(os)))         // 文本编码下，与字符串一样带长度前缀
+            os << sizeof(T) << " ";
+        os.write(reinterpret_cast<const char *>(&val), sizeof(T));
+        if (!isBinary(getCodec(os)))
+            os << " ";
+    }
+    else if constexpr (is_raw_scalar<T>::value)
+    {
+        Codec codec = getCodec(os);
+        if constexpr (is_varint_integral<T>::value)
+        {
+            if (codec == Codec::VARINT)      // 变长编码，有符号数先做 zigzag 变换，使绝对值小的负数也足够短
+            {
+                if constexpr (std::is_signed_v<T>)
+                {
+                    int64_t n = val;
+                    writeVarint(os, (static_cast<uint64_t>(n) << 1) ^ static_cast<uint64_t>(n >> 63));
+                }
+                else writeVarint(os, val);
+                return os;
+            }
+        }
+        if (isBinary(codec))                 // 二进制编码，按定长小端序写入
+            writeRaw(os, val);
+        else if constexpr (std::is_enum_v<T>)
+            os << static_cast<std::underlying_type_t<T>>(val) << " ";
+        else os << val << " ";
+    }
     else os << val << " ";                   // 否则，使用 Serializable 提供的方法
     return os;
 }
@@ -147,6 +450,60 @@ std::istream& Serializable::DeSerialize(std::istream &is, T &val)
 {
     if constexpr (is_serializable<T>::value)
         return T::DeSerialize(is, val);
+    else if constexpr (is_pod_serializable<T>::value)
+    {
+        if (!isBinary(getCodec(is)))
+        {
+            size_t len;
+            is >> len;
+            is.seekg(1, std::ios::cur);
+            if (len != sizeof(T))
+            {
+                is.setstate(std::ios::failbit);
+                return is;
+            }
+        }
+        is.read(reinterpret_cast<char *>(&val), sizeof(T));
+    }
+    else if constexpr (is_raw_scalar<T>::value)
+    {
+        Codec codec = getCodec(is);
+        if constexpr (is_varint_integral<T>::value)
+        {
+            if (codec == Codec::VARINT)
+            {
+                uint64_t u = readVarint(is);
+                if constexpr (std::is_signed_v<T>)
+                {
+                    int64_t n = static_cast<int64_t>(u >> 1) ^ -static_cast<int64_t>(u & 1);
+                    val = static_cast<T>(n);
+                    if (val != n)
+                        is.setstate(std::ios::failbit); // 超出 T 的表示范围
+                }
+                else
+                {
+                    val = static_cast<T>(u);
+                    if (val != u)
+                        is.setstate(std::ios::failbit);
+                }
+                return is;
+            }
+        }
+        if (isBinary(codec))
+            readRaw(is, val);
+        else if constexpr (std::is_enum_v<T>)
+        {
+            std::underlying_type_t<T> temp;
+            is >> temp;
+            is.seekg(1, std::ios::cur);
+            val = static_cast<T>(temp);
+        }
+        else
+        {
+            is >> val;
+            is.seekg(1, std::ios::cur);
+        }
+    }
     else 
     {
         is >> val;
@@ -158,27 +515,100 @@ std::istream& Serializable::DeSerialize(std::istream &is, T &val)
 // 字符串
 std::ostream& Serializable::Serialize(std::ostream &os, const std::string &val)
 {
+    return Serializable::Serialize(os, std::string_view(val));
+}
+
+std::istream& Serializable::DeSerialize(std::istream &is, std::string &val)
+{
+    size_t len = readLength(is);
+    if (!is)
+        return is;
+    if (len > remainingOf(is)) // 长度来自对端，超过剩余的数据时不分配空间
+    {
+        is.setstate(std::ios::failbit);
+        return is;
+    }
+    val.resize(len); // 直接读入 val，不再经过临时缓冲区
+    is.read(val.data(), len);
+    return is;
+}
+
+std::ostream& Serializable::Serialize(std::ostream &os, std::string_view val)
+{
+    if (isBinary(getCodec(os))) // 长度前缀 + 原始字节
+    {
+        Serializable::Serialize(os, val.size());
+        os.write(val.data(), val.size());
+        return os;
+    }
     os << val.size() << " " << val << " ";
     return os;
 }
 
-std::istream& Serializable::DeSerialize(std::istream &is, std::string &val)
+std::istream& Serializable::DeSerialize(std::istream &is, std::string_view &val)
+{
+    ViewBuffer *view = viewOf(is);
+    size_t len = readLength(is);
+    const char *data = view->current();
+    if (!is || !view->skip(len))
+    {
+        is.setstate(std::ios::failbit);
+        return is;
+    }
+    val = std::string_view(data, len);
+    return is;
+}
+
+#if __cplusplus >= 202002L
+template <typename T>
+std::ostream& Serializable::Serialize(std::ostream &os, std::span<const T> val)
+{
+    if constexpr (is_bulk_copyable<T>::value)
+    {
+        if (bulkCopyable<T>(getCodec(os))) // 与 std::vector<T> 的编码相同
+        {
+            Serializable::Serialize(os, val.size());
+            os.write(reinterpret_cast<const char *>(val.data()), val.size_bytes());
+            return os;
+        }
+    }
+    return helper(os, val);
+}
+
+template <typename T>
+std::istream& Serializable::DeSerialize(std::istream &is, std::span<const T> &val)
 {
-    size_t len;
-    is >> len;
-    is.seekg(1, std::ios::cur); // 跳过空格
-    char *buffer = new char[len + 1];
-    is.read(buffer, len);
-    buffer[len] = '\0';
-    val = buffer;
-    delete []buffer;
+    if (!bulkCopyable<T>(getCodec(is)))
+        throw std::runtime_error("Serializable: span element type can not be viewed in current codec");
+    ViewBuffer *view = viewOf(is);
+    size_t size;
+    Serializable::DeSerialize(is, size);
+    const char *data = view->current();
+    if (!is || size > view->remaining() / sizeof(T) || !view->skip(size * sizeof(T)))
+    {
+        is.setstate(std::ios::failbit);
+        return is;
+    }
+    if (reinterpret_cast<uintptr_t>(data) % alignof(T) != 0)
+        throw std::runtime_error("Serializable: span data is misaligned");
+    val = std::span<const T>(reinterpret_cast<const T *>(data), size);
     return is;
 }
+#endif
 
 // 容器
 template <typename T>
 std::ostream& Serializable::Serialize(std::ostream &os, const std::vector<T> &val)
 {
+    if constexpr (is_bulk_copyable<T>::value)
+    {
+        if (bulkCopyable<T>(getCodec(os))) // 长度前缀 + 一整块连续内存
+        {
+            Serializable::Serialize(os, val.size());
+            os.write(reinterpret_cast<const char *>(val.data()), val.size() * sizeof(T));
+            return os;
+        }
+    }
     return helper(os, val);
 }
 
@@ -187,7 +617,26 @@ std::istream& Serializable::DeSerialize(std::istream &is, std::vector<T> &val)
 {
     size_t size;
     Serializable::DeSerialize(is, size);
+    if (!is)
+        return is;
+    // 元素个数来自对端，分配空间之前先检查剩余的数据是否足够：整块拷贝时每个元素 sizeof(T) 个字节，否则至少 1 个字节
+    bool bulk = false;
+    if constexpr (is_bulk_copyable<T>::value)
+        bulk = bulkCopyable<T>(getCodec(is));
+    if (size > remainingOf(is) / (bulk ? sizeof(T) : 1))
+    {
+        is.setstate(std::ios::failbit);
+        return is;
+    }
     val.resize(size);
+    if constexpr (is_bulk_copyable<T>::value)
+    {
+        if (bulk) // 预先分配好空间，一次读入
+        {
+            is.read(reinterpret_cast<char *>(val.data()), size * sizeof(T));
+            return is;
+        }
+    }
     for(size_t i = 0; i < size; ++i)
     {
         Serializable::DeSerialize(is, val[i]);
@@ -205,11 +654,13 @@ template <typename T>
 std::istream& Serializable::DeSerialize(std::istream &is, std::list<T> &val)
 {
     size_t size;
-    Serializable::DeSerialize(is, size);
+    if (!readCount(is, size))
+        return is;
     T temp; // 需要默认构造函数
     for(size_t i = 0; i < size; ++i)
     {
-        Serializable::DeSerialize(is, temp);
+        if (!Serializable::DeSerialize(is, temp))
+            break;
         val.push_back(temp);
     }
     return is;
@@ -218,6 +669,14 @@ std::istream& Serializable::DeSerialize(std::istream &is, std::list<T> &val)
 template <typename T, std::size_t N>
 std::ostream& Serializable::Serialize(std::ostream &os, const std::array<T, N> &val)
 {
+    if constexpr (is_bulk_copyable<T>::value)
+    {
+        if (bulkCopyable<T>(getCodec(os))) // 长度固定为 N，只需写入数据块
+        {
+            os.write(reinterpret_cast<const char *>(val.data()), N * sizeof(T));
+            return os;
+        }
+    }
     for(const auto &elem : val)
         Serializable::Serialize(os, elem);
     return os;
@@ -226,6 +685,14 @@ std::ostream& Serializable::Serialize(std::ostream &os, const std::array<T, N> &
 template <typename T, std::size_t N>
 std::istream& Serializable::DeSerialize(std::istream &is, std::array<T, N> &val)
 {
+    if constexpr (is_bulk_copyable<T>::value)
+    {
+        if (bulkCopyable<T>(getCodec(is)))
+        {
+            is.read(reinterpret_cast<char *>(val.data()), N * sizeof(T));
+            return is;
+        }
+    }
     for (size_t i = 0; i < N; i++)
     {
         Serializable::DeSerialize(is, val[i]);
@@ -251,7 +718,8 @@ template <typename T>
 std::istream& Serializable::DeSerialize(std::istream &is, std::stack<T> &val)
 {
     std::vector<T> temp;
-    Serializable::DeSerialize(is, temp);
+    if (!Serializable::DeSerialize(is, temp))
+        return is;
     for(auto rbeg = temp.rbegin(); rbeg != temp.rend(); ++rbeg)
     {
         val.push(*rbeg);
@@ -277,11 +745,13 @@ template <typename T>
 std::istream& Serializable::DeSerialize(std::istream &is, std::queue<T> &val)
 {
     size_t size;
-    Serializable::DeSerialize(is, size);
+    if (!readCount(is, size))
+        return is;
     T elem;
     while (size--)
     {
-        Serializable::DeSerialize(is, elem);
+        if (!Serializable::DeSerialize(is, elem))
+            break;
         val.push(elem);
     }
     
@@ -298,11 +768,13 @@ template <typename T>
 std::istream& Serializable::DeSerialize(std::istream &is, std::set<T> &val)
 {
     size_t size;
-    Serializable::DeSerialize(is, size);
+    if (!readCount(is, size))
+        return is;
     T temp;
     for(size_t i = 0; i < size; ++i)
     {
-        Serializable::DeSerialize(is, temp);
+        if (!Serializable::DeSerialize(is, temp))
+            break;
         val.insert(temp);
     }
     return is;
@@ -318,11 +790,13 @@ template <typename T>
 std::istream& Serializable::DeSerialize(std::istream &is, std::unordered_set<T> &val)
 {
     size_t size;
-    Serializable::DeSerialize(is, size);
+    if (!readCount(is, size))
+        return is;
     T temp;
     for(size_t i = 0; i < size; ++i)
     {
-        Serializable::DeSerialize(is, temp);
+        if (!Serializable::DeSerialize(is, temp))
+            break;
         val.insert(temp);
     }
     return is;
@@ -356,10 +830,12 @@ std::istream& Serializable::DeSerialize(std::istream &is, std::map<K, V> &val)
     size_t size;
     std::pair<K, V> p;
 
-    Serializable::DeSerialize(is, size);
+    if (!readCount(is, size))
+        return is;
     for (size_t i = 0; i < size; ++i)
     {
-        Serializable::DeSerialize(is, p);
+        if (!Serializable::DeSerialize(is, p))
+            break;
         val.insert(p);
     }
 
@@ -378,10 +854,12 @@ std::istream& Serializable::DeSerialize(std::istream &is, std::unordered_map<K,
     size_t size;
     std::pair<K, V> p;
 
-    Serializable::DeSerialize(is, size);
+    if (!readCount(is, size))
+        return is;
     for (size_t i = 0; i < size; ++i)
     {
-        Serializable::DeSerialize(is, p);
+        if (!Serializable::DeSerialize(is, p))
+            break;
         val.insert(p);
     }
 
@@ -408,11 +886,13 @@ template <typename Tp, typename Sequence, typename Compare>
 std::istream& Serializable::DeSerialize(std::istream &is, std::priority_queue<Tp, Sequence, Compare> &val)
 {
     size_t size;
-    Serializable::DeSerialize(is, size);
+    if (!readCount(is, size))
+        return is;
     typename std::priority_queue<Tp, Sequence, Compare>::value_type elem;
     while (size--)
     {
-        Serializable::DeSerialize(is, elem);
+        if (!Serializable::DeSerialize(is, elem))
+            break;
         val.push(elem);
     }
     return is;
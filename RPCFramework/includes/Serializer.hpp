@@ -1,32 +1,143 @@
 #pragma once
 #include <iostream>
-#include <sstream>
 #include <string>
 #include <typeinfo>
 #include "Serializable.hpp"
+#include "Buffer.hpp"
 
 /**
  * @brief 简单的序列化与反序列化工具，可以实现任意对象的序列化和反序列化过程，但该对象必须重载 << 和 >> 运算符
+ * 
+ * codec 指定编码方式，默认为 Serializable::DEFAULT_CODEC
  *
  */
 class Serializer
 {
 public:
     template <typename T>
-    static std::string Serialize(T &&object)
+    static std::string Serialize(T &&object, Codec codec = Serializable::DEFAULT_CODEC)
     {
-        std::ostringstream os;
-        Serializable::Serialize(os, object);
-        return os.str();
+        std::string out;
+        Serialize(object, out, codec);
+        return out;
     }
 
+    // 追加到 out 的末尾，out 可以重复使用，避免每次分配内存
+    template <typename T>
+    static void Serialize(const T &object, std::string &out, Codec codec = Serializable::DEFAULT_CODEC)
+    {
+        useWriter(out, codec, [&](std::ostream &os)
+        {
+            Serializable::Serialize(os, object);
+        });
+    }
+
+    template <typename T>
+    static T
+    Deserialize(const std::string &serializedData, Codec codec = Serializable::DEFAULT_CODEC)
+    {
+        return Deserialize<T>(serializedData.data(), serializedData.size(), codec);
+    }
+
+    // 直接从 data 中反序列化，不拷贝数据，结果中的 std::string_view、std::span 指向 data
     template <typename T>
     static T
-    Deserialize(const std::string &serializedData)
+    Deserialize(const char *data, size_t len, Codec codec = Serializable::DEFAULT_CODEC)
     {
-        std::istringstream is(serializedData);
         T object;
-        Serializable::DeSerialize(is, object);
+        useReader(data, len, codec, [&](std::istream &is)
+        {
+            Serializable::DeSerialize(is, object);
+        });
         return object;
     }
+
+    /**
+     * @brief 使用当前线程复用的输出流，将 f 写入的数据追加到 out 的末尾
+     * 
+     * 每个线程只构造一次流对象，嵌套调用时（例如自定义类型的 Serialize 中又调用了 Serializer）使用临时的流
+     */
+    template <typename F>
+    static void useWriter(std::string &out, Codec codec, F &&f)
+    {
+        Writer &w = writer();
+        if (w.busy)
+        {
+            WriteBuffer buffer(out);
+            std::ostream os(&buffer);
+            Serializable::setCodec(os, codec);
+            f(os);
+            buffer.finish();
+            return;
+        }
+        Borrow borrow(w.busy);
+        w.buffer.attach(out);
+        w.os.clear();
+        Serializable::setCodec(w.os, codec);
+        try
+        {
+            f(w.os);
+        }
+        catch(...)
+        {
+            w.buffer.finish();
+            throw;
+        }
+        w.buffer.finish();
+    }
+
+    // 使用当前线程复用的输入流，从 data 中读取
+    template <typename F>
+    static void useReader(const char *data, size_t len, Codec codec, F &&f)
+    {
+        Reader &r = reader();
+        if (r.busy)
+        {
+            ViewBuffer buffer(data, len);
+            std::istream is(&buffer);
+            Serializable::setCodec(is, codec);
+            f(is);
+            return;
+        }
+        Borrow borrow(r.busy);
+        r.buffer.reset(data, len);
+        r.is.clear();
+        Serializable::setCodec(r.is, codec);
+        f(r.is);
+    }
+
+private:
+    struct Writer
+    {
+        WriteBuffer buffer;
+        std::ostream os{&buffer};
+        bool busy = false;
+    };
+
+    struct Reader
+    {
+        ViewBuffer buffer;
+        std::istream is{&buffer};
+        bool busy = false;
+    };
+
+    // 标记流正在使用，离开作用域（包括抛出异常）时自动归还
+    struct Borrow
+    {
+        bool &busy;
+        Borrow(bool &busy) : busy(busy) { busy = true; }
+        ~Borrow() { busy = false; }
+    };
+
+    static Writer &writer()
+    {
+        thread_local Writer w;
+        return w;
+    }
+
+    static Reader &reader()
+    {
+        thread_local Reader r;
+        return r;
+    }
 };
\ No newline at end of file
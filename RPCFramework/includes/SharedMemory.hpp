@@ -0,0 +1,487 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <cerrno>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+#include "TCPSocket.hpp"
+#include "Frame.hpp"
+
+/**
+ * @brief 共享内存中一个方向的环形缓冲区的控制块，生产者、消费者各自的字段位于不同的 cache line
+ *
+ */
+struct RingControl
+{
+    alignas(64) std::atomic<uint64_t> head;              // 消费者已经读到的位置
+    std::atomic<uint32_t> consumer_sleeping;             // 消费者没有数据可读，等待 eventfd 唤醒
+    alignas(64) std::atomic<uint64_t> tail;              // 生产者已经写到的位置
+    std::atomic<uint32_t> producer_sleeping;             // 生产者没有空间可写，等待 eventfd 唤醒
+};
+
+/**
+ * @brief 共享内存中的单生产者、单消费者环形缓冲区
+ *
+ * 每条记录就是一个完整的帧（参见 Frame）：[ 4 字节长度（网络字节序）][ 数据 ]，按 8 字节对齐
+ * 环的末尾放不下一条记录时，写入一条填充记录，从头开始写，保证每条记录在内存中连续
+ * 另一端不可信：读写时检查对端修改的位置与长度，出错后 corrupted 返回 true，之后不再读写
+ *
+ */
+class SharedRing
+{
+public:
+    static constexpr uint32_t PADDING = 0xffffffff; // 填充记录的长度字段
+
+    SharedRing() = default;
+
+    // ctrl、data 位于共享内存中；capacity 为 2 的幂
+    SharedRing(RingControl *ctrl, char *data, uint64_t capacity)
+        : ctrl(ctrl), data(data), capacity(capacity) {}
+
+    // 写入一个完整的帧（含帧头），空间不足时返回 false
+    bool write(const char *frame, size_t len);
+
+    // 读取下一个帧的数据部分（不含帧头），写入 payload（覆盖原有内容），没有数据时返回 false
+    bool read(std::string &payload);
+
+    bool empty() const
+    {return ctrl->head.load(std::memory_order_acquire) == ctrl->tail.load(std::memory_order_acquire);}
+
+    // 能否立即写入 len 字节的帧（不考虑填充）
+    bool writable(size_t len) const
+    {return capacity - (ctrl->tail.load(std::memory_order_relaxed) - ctrl->head.load(std::memory_order_acquire)) >= align(len);}
+
+    // 单个帧的最大长度（含帧头）
+    uint64_t max_frame() const
+    {return capacity;}
+
+    bool corrupted() const
+    {return broken;}
+
+    RingControl *control() const
+    {return ctrl;}
+
+private:
+    RingControl *ctrl = nullptr;
+    char *data = nullptr;
+    uint64_t capacity = 0;
+    bool broken = false;
+
+    static uint64_t align(uint64_t len)
+    {return (len + 7) & ~uint64_t(7);}
+};
+
+/**
+ * @brief 一个客户端的共享内存区域：请求、响应两个环形缓冲区
+ *
+ * 布局：[ ShmHeader ][ 请求环控制块 ][ 响应环控制块 ]（一页）[ 请求环 ][ 响应环 ]
+ * 客户端创建 memfd 与两个 eventfd，通过 AF_UNIX socket（SCM_RIGHTS）交给服务端；
+ * 该 socket 保持连接，任意一端关闭时，另一端得知对方已经退出
+ * eventfd 只在对端等待时才写：req_event 唤醒服务端（有新的请求，或响应环有了空间），
+ * resp_event 唤醒客户端（有新的响应，或请求环有了空间）
+ *
+ */
+class ShmRegion
+{
+public:
+    static constexpr uint32_t MAGIC = 0x52504353;              // "RPCS"
+    static constexpr uint64_t DEFAULT_RING_SIZE = 1 << 20;     // 默认每个环的大小
+    static constexpr uint64_t MAX_RING_SIZE = 1ull << 30;      // 每个环的大小的上限，服务端拒绝更大的环
+    static constexpr size_t CONTROL_SIZE = 4096;               // 控制块所在的页
+
+    struct ShmHeader
+    {
+        uint32_t magic;
+        uint32_t reserved;
+        uint64_t ring_size;
+    };
+
+    ShmRegion() = default;
+    ~ShmRegion();
+
+    ShmRegion(const ShmRegion &) = delete;
+    ShmRegion &operator=(const ShmRegion &) = delete;
+
+    // 客户端：创建共享内存与 eventfd
+    void create(uint64_t ringSize);
+
+    // 服务端：映射客户端交来的 memfd，检查布局；接管三个 fd 的所有权
+    void attach(int memfd, int reqEvent, int respEvent);
+
+    // 服务端：从非阻塞的 AF_UNIX 连接 sock 中接收客户端交来的 fd 并 attach；还没有收到时返回 false，出错时抛出异常
+    bool accept(int sock);
+
+    int memfd() const
+    {return mem_fd;}
+
+    int req_event() const
+    {return req_fd;}
+
+    int resp_event() const
+    {return resp_fd;}
+
+    SharedRing &requests()
+    {return req;}
+
+    SharedRing &responses()
+    {return resp;}
+
+    // 唤醒在 fd 上等待的一端
+    static void notify(int fd);
+
+    // 清除 fd 上的通知
+    static void drain(int fd);
+
+private:
+    int mem_fd = -1;
+    int req_fd = -1;
+    int resp_fd = -1;
+    void *base = nullptr;
+    size_t size = 0;
+    SharedRing req, resp;
+
+    void map(uint64_t ringSize, bool init);
+};
+
+/**
+ * @brief 客户端的共享内存通道，接口与 TCPSocket 的 sendFrame、receive 相同
+ *
+ * 同一主机上的客户端通过 "shm:/path" 连接，path 为服务端的 RPCServerOptions::shm_path
+ * 请求、响应各复制一次（用户态的 memcpy），不经过内核；对端忙碌时不需要任何系统调用
+ *
+ */
+class ShmChannel
+{
+public:
+    explicit ShmChannel(const std::string &path, uint64_t ringSize = ShmRegion::DEFAULT_RING_SIZE);
+    ~ShmChannel();
+
+    // 发送已经包含帧头的数据，请求环已满时最多等到 deadline，超时返回 false（帧整体写入，不会只写出一部分）
+    bool sendFrame(const std::string &frame, std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max());
+
+    // 接收下一个帧的数据部分（不含帧头），写入 buffer（覆盖原有内容）
+    void receive(std::string &buffer);
+
+    // 同上，最多等到 deadline，超时返回 false
+    bool receive(std::string &buffer, std::chrono::steady_clock::time_point deadline);
+
+    void close();
+
+private:
+    TCPSocket control; // AF_UNIX 连接，用于交换 fd，以及得知服务端退出
+    ShmRegion region;
+    bool closed = false;
+
+    // 等待 resp_event，最多等到 deadline，超时返回 false；服务端关闭连接时抛出异常
+    bool wait(std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max());
+};
+
+inline bool SharedRing::write(const char *frame, size_t len)
+{
+    if (broken)
+        return false;
+    uint64_t need = align(len);
+    if (need > capacity)
+    {
+        broken = true;
+        return false;
+    }
+    uint64_t tail = ctrl->tail.load(std::memory_order_relaxed);
+    while (true)
+    {
+        uint64_t head = ctrl->head.load(std::memory_order_acquire);
+        uint64_t used = tail - head;
+        if (used > capacity)
+        {
+            broken = true;
+            return false;
+        }
+        uint64_t offset = tail & (capacity - 1);
+        uint64_t contiguous = capacity - offset;
+        if (contiguous < need)
+        {
+            // 末尾放不下，先填充到环的开头；填充也放不下时，等待消费者
+            if (capacity - used < contiguous)
+                return false;
+            uint32_t padding = PADDING;
+            std::memcpy(data + offset, &padding, sizeof(padding));
+            tail += contiguous;
+            ctrl->tail.store(tail, std::memory_order_release);
+            continue;
+        }
+        if (capacity - used < need)
+            return false;
+        std::memcpy(data + offset, frame, len);
+        ctrl->tail.store(tail + need, std::memory_order_release);
+        return true;
+    }
+}
+
+inline bool SharedRing::read(std::string &payload)
+{
+    if (broken)
+        return false;
+    uint64_t head = ctrl->head.load(std::memory_order_relaxed);
+    while (true)
+    {
+        uint64_t tail = ctrl->tail.load(std::memory_order_acquire);
+        if (head == tail)
+            return false;
+        uint64_t offset = head & (capacity - 1);
+        uint32_t raw;
+        if (tail - head > capacity || tail - head < Frame::HEADER_SIZE)
+        {
+            broken = true;
+            return false;
+        }
+        std::memcpy(&raw, data + offset, sizeof(raw));
+        if (raw == PADDING)
+        {
+            head += capacity - offset;
+            ctrl->head.store(head, std::memory_order_release);
+            continue;
+        }
+        uint64_t len = Frame::parse(data + offset);
+        uint64_t size = align(Frame::HEADER_SIZE + len);
+        if (size > capacity - offset || size > tail - head)
+        {
+            broken = true;
+            return false;
+        }
+        payload.assign(data + offset + Frame::HEADER_SIZE, len);
+        ctrl->head.store(head + size, std::memory_order_release);
+        return true;
+    }
+}
+
+inline ShmRegion::~ShmRegion()
+{
+    if (base)
+        munmap(base, size);
+    for (int fd : {mem_fd, req_fd, resp_fd})
+        if (fd != -1)
+            ::close(fd);
+}
+
+inline void ShmRegion::create(uint64_t ringSize)
+{
+    if (ringSize < 4096 || ringSize > MAX_RING_SIZE || (ringSize & (ringSize - 1)) != 0)
+        throw std::runtime_error("ShmRegion: ring size must be a power of 2 between 4096 and MAX_RING_SIZE");
+    mem_fd = memfd_create("rpc-shm", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (mem_fd < 0)
+        throw std::runtime_error("memfd_create error: " + std::string(strerror(errno)));
+    // 禁止之后缩小，否则服务端访问映射时可能收到 SIGBUS
+    if (ftruncate(mem_fd, CONTROL_SIZE + 2 * ringSize) < 0 || fcntl(mem_fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_SEAL) < 0)
+        throw std::runtime_error("memfd error: " + std::string(strerror(errno)));
+    req_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    resp_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (req_fd < 0 || resp_fd < 0)
+        throw std::runtime_error("eventfd error: " + std::string(strerror(errno)));
+    map(ringSize, true);
+}
+
+inline void ShmRegion::attach(int memfd, int reqEvent, int respEvent)
+{
+    mem_fd = memfd;
+    req_fd = reqEvent;
+    resp_fd = respEvent;
+
+    // 布局由客户端决定，映射之前先检查大小
+    struct stat st;
+    ShmHeader header;
+    // 不是 memfd 时（例如客户端自己的 tmpfs 文件）返回 -1，之后被截断会使服务端收到 SIGBUS
+    int seals = fcntl(mem_fd, F_GET_SEALS);
+    if (seals < 0 || !(seals & F_SEAL_SHRINK))
+        throw std::runtime_error("ShmRegion: shared memory is not sealed");
+    if (fstat(mem_fd, &st) < 0 || static_cast<size_t>(st.st_size) < CONTROL_SIZE
+        || pread(mem_fd, &header, sizeof(header), 0) != sizeof(header))
+        throw std::runtime_error("ShmRegion: invalid shared memory");
+    // 先限制 ring_size，再计算映射的大小，避免 CONTROL_SIZE + 2 * ring_size 溢出
+    if (header.magic != MAGIC || header.ring_size < 4096 || header.ring_size > MAX_RING_SIZE
+        || (header.ring_size & (header.ring_size - 1)) != 0
+        || header.ring_size > (static_cast<uint64_t>(st.st_size) - CONTROL_SIZE) / 2)
+        throw std::runtime_error("ShmRegion: invalid shared memory layout");
+    map(header.ring_size, false);
+}
+
+inline bool ShmRegion::accept(int sock)
+{
+    int fds[3];
+    char byte;
+    iovec iov{&byte, 1};
+    alignas(cmsghdr) char cmsgbuf[CMSG_SPACE(sizeof(fds))];
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cmsgbuf;
+    msg.msg_controllen = sizeof(cmsgbuf);
+    ssize_t n = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+        return false;
+    if (n <= 0)
+        throw std::runtime_error("recvmsg error: " + std::string(n == 0 ? "connection closed" : strerror(errno)));
+
+    cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    if (cmsg == nullptr || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+        throw std::runtime_error("ShmRegion: no file descriptors received");
+    size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+    std::memcpy(fds, CMSG_DATA(cmsg), std::min(count, size_t(3)) * sizeof(int));
+    if (count != 3 || (msg.msg_flags & MSG_CTRUNC))
+    {
+        for (size_t i = 0; i < std::min(count, size_t(3)); i++)
+            ::close(fds[i]);
+        throw std::runtime_error("ShmRegion: unexpected file descriptors");
+    }
+    attach(fds[0], fds[1], fds[2]);
+    return true;
+}
+
+inline void ShmRegion::map(uint64_t ringSize, bool init)
+{
+    size = CONTROL_SIZE + 2 * ringSize;
+    base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, mem_fd, 0);
+    if (base == MAP_FAILED)
+    {
+        base = nullptr;
+        throw std::runtime_error("mmap error: " + std::string(strerror(errno)));
+    }
+    char *mem = static_cast<char *>(base);
+    RingControl *ctrls = reinterpret_cast<RingControl *>(mem + sizeof(RingControl));
+    if (init)
+    {
+        ShmHeader header{MAGIC, 0, ringSize};
+        std::memcpy(mem, &header, sizeof(header));
+        new (&ctrls[0]) RingControl{};
+        new (&ctrls[1]) RingControl{};
+    }
+    req = SharedRing(&ctrls[0], mem + CONTROL_SIZE, ringSize);
+    resp = SharedRing(&ctrls[1], mem + CONTROL_SIZE + ringSize, ringSize);
+}
+
+inline void ShmRegion::notify(int fd)
+{
+    uint64_t one = 1;
+    while (::write(fd, &one, sizeof(one)) < 0 && errno == EINTR)
+        ;
+}
+
+inline void ShmRegion::drain(int fd)
+{
+    uint64_t value;
+    while (::read(fd, &value, sizeof(value)) < 0 && errno == EINTR)
+        ;
+}
+
+inline ShmChannel::ShmChannel(const std::string &path, uint64_t ringSize)
+{
+    region.create(ringSize);
+    control.connect("unix:" + path, 0);
+
+    // 通过 SCM_RIGHTS 把 memfd 与两个 eventfd 交给服务端
+    int fds[3] = {region.memfd(), region.req_event(), region.resp_event()};
+    char byte = 0;
+    iovec iov{&byte, 1};
+    alignas(cmsghdr) char cmsgbuf[CMSG_SPACE(sizeof(fds))];
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cmsgbuf;
+    msg.msg_controllen = sizeof(cmsgbuf);
+    cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    std::memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+    if (sendmsg(control.native_sock(), &msg, MSG_NOSIGNAL) < 0)
+        throw std::runtime_error("sendmsg error: " + std::string(strerror(errno)));
+}
+
+inline ShmChannel::~ShmChannel()
+{
+    close();
+}
+
+inline bool ShmChannel::sendFrame(const std::string &frame, std::chrono::steady_clock::time_point deadline)
+{
+    SharedRing &ring = region.requests();
+    if (frame.size() > ring.max_frame())
+        throw std::runtime_error("send error: frame is too large for shared memory");
+    while (!ring.write(frame.data(), frame.size()))
+    {
+        if (ring.corrupted())
+            throw std::runtime_error("send error: shared memory is corrupted");
+        // 请求环已满：先声明等待，再检查一次，避免服务端在此之间读完而遗漏通知
+        ring.control()->producer_sleeping.store(1, std::memory_order_seq_cst);
+        bool woken = ring.writable(frame.size()) || wait(deadline);
+        ring.control()->producer_sleeping.store(0, std::memory_order_relaxed);
+        if (!woken)
+            return false;
+    }
+    std::atomic_thread_fence(std::memory_order_seq_cst); // 写入 tail 与读取 consumer_sleeping 不能重排
+    if (ring.control()->consumer_sleeping.load(std::memory_order_relaxed))
+        ShmRegion::notify(region.req_event());
+    return true;
+}
+
+inline void ShmChannel::receive(std::string &buffer)
+{
+    receive(buffer, std::chrono::steady_clock::time_point::max());
+}
+
+inline bool ShmChannel::receive(std::string &buffer, std::chrono::steady_clock::time_point deadline)
+{
+    SharedRing &ring = region.responses();
+    while (!ring.read(buffer))
+    {
+        if (ring.corrupted())
+            throw std::runtime_error("recv error: shared memory is corrupted");
+        ring.control()->consumer_sleeping.store(1, std::memory_order_seq_cst);
+        bool woken = !ring.empty() || wait(deadline);
+        ring.control()->consumer_sleeping.store(0, std::memory_order_relaxed);
+        if (!woken && !ring.read(buffer))
+            return false;
+    }
+    // 服务端在等待响应环的空间
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (ring.control()->producer_sleeping.load(std::memory_order_relaxed))
+        ShmRegion::notify(region.req_event());
+    return true;
+}
+
+inline bool ShmChannel::wait(std::chrono::steady_clock::time_point deadline)
+{
+    pollfd fds[2] = {{region.resp_event(), POLLIN, 0}, {control.native_sock(), POLLIN, 0}};
+    int n;
+    while ((n = poll(fds, 2, poll_timeout(deadline))) < 0)
+    {
+        if (errno != EINTR)
+            throw std::runtime_error("poll error: " + std::string(strerror(errno)));
+    }
+    if (n == 0)
+        return false;
+    // 服务端不会通过 control 发送数据，可读即意味着连接已经关闭
+    if (fds[1].revents)
+        throw std::runtime_error("recv error: connection closed");
+    ShmRegion::drain(region.resp_event());
+    return true;
+}
+
+inline void ShmChannel::close()
+{
+    if (closed)
+        return;
+    control.close();
+    closed = true;
+}
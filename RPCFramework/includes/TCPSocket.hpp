@@ -6,25 +6,45 @@
 #include <cstring>
 #include <cstdlib>
 #include <cassert>
+#include <climits>
+#include <chrono>
 
 #include <unistd.h>
+#include <poll.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/stat.h>
+#include <sys/un.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 
 sockaddr_in get_sockaddr_in(const std::string &ip, uint16_t port);
 
+// 解析 "unix:/path" 形式的地址：是 AF_UNIX 地址时返回 true，并得到路径
+bool parse_unix_endpoint(const std::string &endpoint, std::string &path);
+sockaddr_un get_sockaddr_un(const std::string &path);
+
+// 关闭 Nagle 算法：RPC 的请求、响应都很小，且多个请求可能连续发出，不应等待 ACK 再发送
+void set_no_delay(int sock);
+
+// 距离 deadline 的毫秒数（向上取整），用作 poll 的超时时间；deadline 为 time_point::max() 时返回 -1（一直等待）
+int poll_timeout(std::chrono::steady_clock::time_point deadline);
+
 class TCPSocket
 {
     std::string IP;
     uint16_t port;
     int _native_sock;
     bool closed;
+    std::string unixPath; // 监听的 AF_UNIX 路径，关闭时删除
     std::mutex send_lock, read_lock;
 
 public:
     TCPSocket();
-    TCPSocket(const std::string &ip, uint16_t port, int backlog);
+    // reusePort 为 true 时设置 SO_REUSEPORT，多个 socket 可以监听同一端口，由内核分配连接
+    // ip 为 "unix:/path" 时监听 AF_UNIX 的流式 socket，忽略 port，路径已经存在时先删除
+    TCPSocket(const std::string &ip, uint16_t port, int backlog, bool reusePort = false);
     ~TCPSocket();
 
     /* server 用 */
@@ -33,11 +53,17 @@ public:
     TCPSocket *accept(void);
 
     /* client 用 */
+    // IP 为 "unix:/path" 时连接 AF_UNIX 的 socket，忽略 port
     void connect(const std::string &IP, uint16_t port);
 
     /* server 和 client 用 */
     void send(const std::string &msg);
+    // 发送已经包含帧头的数据（参见 Frame），不再拼接帧头
+    // 非阻塞的 socket 最多等到 deadline，超时返回 false；此时帧已经写出一部分的，连接随之关闭（字节流无法再对齐帧）
+    bool sendFrame(const std::string &frame, std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max());
     std::string receive(void);
+    // 接收到 buffer 中（覆盖原有内容），buffer 可以重复使用，避免每次分配内存
+    void receive(std::string &buffer);
     void close();
 
     std::string getIP() const
@@ -49,18 +75,47 @@ public:
     int native_sock() const
     {return _native_sock;}
 
+    bool isClosed() const
+    {return closed;}
+
 private:
+    // 发送 iov 中的全部数据，处理部分发送；超过 deadline 时返回 false，已经写出一部分时关闭连接
+    bool sendAll(iovec *iov, int iovcnt, std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max());
+
     // 分配 socket
-    int initSocket(void);
+    int initSocket(int domain = AF_INET);
 };
 
 // 不应该在这里调用 socket 创建套接字，存在文件描述符泄漏问题
 TCPSocket::TCPSocket()
     :_native_sock(-1), closed(false) {}
 
-TCPSocket::TCPSocket(const std::string &ip, uint16_t port, int backlog)
+TCPSocket::TCPSocket(const std::string &ip, uint16_t port, int backlog, bool reusePort)
     : TCPSocket()
 {
+    std::string path;
+    if (parse_unix_endpoint(ip, path))
+    {
+        if (reusePort)
+            throw std::runtime_error("SO_REUSEPORT is not supported by unix domain socket");
+        _native_sock = initSocket(AF_UNIX);
+        this->IP = ip;
+        this->port = 0;
+        sockaddr_un address = get_sockaddr_un(path);
+        // 只删除上次运行留下的 socket 文件；路径上是其它文件（配置错误）时不删除，由 bind 报告 EADDRINUSE
+        struct stat st;
+        if (::lstat(path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode))
+            ::unlink(path.c_str());
+        if (::bind(native_sock(), (sockaddr *)&address, sizeof(address)) < 0)
+        {
+            std::string errorMsg(strerror(errno));
+            throw std::runtime_error("bind error: " + errorMsg);
+        }
+        unixPath = path;
+        listen(backlog);
+        return;
+    }
+
     if (inet_addr(ip.c_str()) == INADDR_NONE)
         throw std::runtime_error("Illegal host");
     if (port < 0 || port > 0xffff)
@@ -74,6 +129,11 @@ TCPSocket::TCPSocket(const std::string &ip, uint16_t port, int backlog)
     socklen_t optlen = sizeof(opinion);
     opinion = 1;
     setsockopt(native_sock(), SOL_SOCKET, SO_REUSEADDR, &opinion, optlen);
+    if (reusePort && setsockopt(native_sock(), SOL_SOCKET, SO_REUSEPORT, &opinion, optlen) < 0)
+    {
+        std::string errorMsg(strerror(errno));
+        throw std::runtime_error("setsockopt SO_REUSEPORT error: " + errorMsg);
+    }
 
     bind();
     listen(backlog);
@@ -120,11 +180,26 @@ TCPSocket *TCPSocket::accept(void)
     ret->_native_sock = clnt_sock;
     ret->IP = inet_ntoa(clnt_addr.sin_addr);
     ret->port = ntohs(clnt_addr.sin_port);
+    set_no_delay(clnt_sock);
     return ret;
 }
 
 void TCPSocket::connect(const std::string &ip, uint16_t port)
 {
+    std::string path;
+    if (parse_unix_endpoint(ip, path))
+    {
+        _native_sock = initSocket(AF_UNIX);
+        sockaddr_un serv_addr = get_sockaddr_un(path);
+        if (::connect(native_sock(), (sockaddr *)&serv_addr, sizeof(serv_addr)) < 0)
+        {
+            std::string errorMsg(strerror(errno));
+            throw std::runtime_error("connect error: " + errorMsg);
+        }
+        IP = ip;
+        return;
+    }
+
     _native_sock = initSocket();
     sockaddr_in serv_addr = get_sockaddr_in(ip, port);
 
@@ -134,6 +209,7 @@ void TCPSocket::connect(const std::string &ip, uint16_t port)
         std::string errorMsg(strerror(errno));
         throw std::runtime_error("connect error: " + errorMsg);
     }
+    set_no_delay(native_sock());
 }
 
 void TCPSocket::close(void)
@@ -141,6 +217,8 @@ void TCPSocket::close(void)
     if (closed)
         return;
     ::close(native_sock());
+    if (!unixPath.empty())
+        ::unlink(unixPath.c_str());
     closed = true;
 }
 
@@ -148,39 +226,96 @@ void TCPSocket::send(const std::string &msg)
 {
     // 构造消息头，包含数据包的长度信息
     uint32_t msgLength = htonl(msg.size()); // 转化为网络字节序
-    // 将 msgLength 强转，封装在消息头部
-    std::string packet = std::string(reinterpret_cast<const char *>(&msgLength), sizeof(msgLength)) + msg;
+    // 消息头与消息体通过 writev 一起发送，不需要拼接
+    iovec iov[2];
+    iov[0].iov_base = &msgLength;
+    iov[0].iov_len = sizeof(msgLength);
+    iov[1].iov_base = const_cast<char *>(msg.data());
+    iov[1].iov_len = msg.size();
+    sendAll(iov, 2);
+}
 
-    int sendSize;
-    {
-        // std::lock_guard<std::mutex> lock(send_lock);
-        sendSize = ::send(native_sock(), packet.data(), packet.size(), 0);
-    }
-    if (sendSize < 0)
+bool TCPSocket::sendFrame(const std::string &frame, std::chrono::steady_clock::time_point deadline)
+{
+    iovec iov;
+    iov.iov_base = const_cast<char *>(frame.data());
+    iov.iov_len = frame.size();
+    return sendAll(&iov, 1, deadline);
+}
+
+bool TCPSocket::sendAll(iovec *iov, int iovcnt, std::chrono::steady_clock::time_point deadline)
+{
+    // std::lock_guard<std::mutex> lock(send_lock);
+    if (closed)
+        throw std::runtime_error("send error: connection closed");
+    bool partial = false; // 已经写出了一部分
+    while (iovcnt > 0)
     {
-        std::string errorMsg(strerror(errno));
-        throw std::runtime_error("send error: " + errorMsg);
+        ssize_t sendSize = ::writev(native_sock(), iov, iovcnt);
+        if (sendSize < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            // 非阻塞的 socket（例如客户端需要超时接收时），等待可写后继续；已经写出一部分的帧必须写完
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                pollfd pfd{native_sock(), POLLOUT, 0};
+                int n = poll(&pfd, 1, poll_timeout(deadline));
+                if (n < 0 && errno != EINTR)
+                    throw std::runtime_error("poll error: " + std::string(strerror(errno)));
+                if (n == 0)
+                {
+                    if (partial)
+                        close();
+                    return false;
+                }
+                continue;
+            }
+            std::string errorMsg(strerror(errno));
+            throw std::runtime_error("send error: " + errorMsg);
+        }
+        // 跳过已经发送的部分
+        partial = true;
+        while (iovcnt > 0 && static_cast<size_t>(sendSize) >= iov->iov_len)
+        {
+            sendSize -= iov->iov_len;
+            ++iov;
+            --iovcnt;
+        }
+        if (iovcnt > 0)
+        {
+            iov->iov_base = static_cast<char *>(iov->iov_base) + sendSize;
+            iov->iov_len -= sendSize;
+        }
     }
+    return true;
 }
 
 std::string TCPSocket::receive(void)
+{
+    std::string buffer;
+    receive(buffer);
+    return buffer;
+}
+
+void TCPSocket::receive(std::string &buffer)
 {
     uint32_t msgLength;
     ssize_t readSize;
     {
         std::lock_guard<std::mutex> lock(read_lock);
         // 先来获取消息头，注意，在读的时候，需要强转的类型应该与之前一致
-        readSize = recv(native_sock(), reinterpret_cast<char *>(&msgLength), sizeof(msgLength), 0);
+        readSize = recv(native_sock(), reinterpret_cast<char *>(&msgLength), sizeof(msgLength), MSG_WAITALL);
     }
 
     if (readSize <= 0)
     {
-        std::string errorMsg(strerror(errno));
+        std::string errorMsg(readSize == 0 ? "connection closed" : strerror(errno));
         throw std::runtime_error("recv error: " + errorMsg);
     }
 
     msgLength = ntohl(msgLength);
-    std::string buffer(msgLength, '\0');
+    buffer.resize(msgLength);
     int remainingSize = msgLength;
     int offset = 0;
 
@@ -191,16 +326,14 @@ std::string TCPSocket::receive(void)
             std::lock_guard<std::mutex> lock(read_lock);
             chunkSize = recv(native_sock(), &buffer[offset], remainingSize, 0);
         }
-        if (chunkSize < 0)
+        if (chunkSize <= 0)
         {
-            std::string errorMsg(strerror(errno));
+            std::string errorMsg(chunkSize == 0 ? "connection closed" : strerror(errno));
             throw std::runtime_error("recv error: " + errorMsg);
         }
         remainingSize -= chunkSize;
         offset += chunkSize;
     }
-
-    return buffer;
 }
 
 // 工具函数
@@ -213,13 +346,51 @@ sockaddr_in get_sockaddr_in(const std::string &ip, uint16_t port)
     return address;
 }
 
-int TCPSocket::initSocket(void)
+bool parse_unix_endpoint(const std::string &endpoint, std::string &path)
+{
+    static const std::string prefix = "unix:";
+    if (endpoint.compare(0, prefix.size(), prefix) != 0)
+        return false;
+    path = endpoint.substr(prefix.size());
+    return true;
+}
+
+sockaddr_un get_sockaddr_un(const std::string &path)
+{
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(address.sun_path))
+        throw std::runtime_error("Illegal unix socket path: " + path);
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    return address;
+}
+
+int TCPSocket::initSocket(int domain)
 {
-    _native_sock = socket(AF_INET, SOCK_STREAM, 0);
+    _native_sock = socket(domain, SOCK_STREAM, 0);
     if (_native_sock < 0)
     {
         std::string errorMsg(strerror(errno));
         throw std::runtime_error("socket error: " + errorMsg);
     }
     return _native_sock;
-}
\ No newline at end of file
+}
+
+void set_no_delay(int sock)
+{
+    // 对 AF_UNIX 的 socket 无效（EOPNOTSUPP），忽略即可
+    int opinion = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &opinion, sizeof(opinion));
+}
+
+int poll_timeout(std::chrono::steady_clock::time_point deadline)
+{
+    if (deadline == std::chrono::steady_clock::time_point::max())
+        return -1;
+    auto now = std::chrono::steady_clock::now();
+    if (deadline <= now)
+        return 0;
+    auto ms = std::chrono::ceil<std::chrono::milliseconds>(deadline - now).count();
+    return ms > INT_MAX ? INT_MAX : static_cast<int>(ms);
+}
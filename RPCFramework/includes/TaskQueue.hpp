@@ -1,53 +1,161 @@
 #pragma once
 
 #include "ThreadPool.h"
+#include <deque>
+#include <atomic>
+#include <chrono>
 #include <iostream>
 
-class TaskQueue
+// 队列已满时的处理方式
+enum class OverflowPolicy
 {
-    int thread_num;
-    const int max_task_count;
-    ThreadPool pool;
+    REJECT,      // 拒绝新的任务
+    DROP_OLDEST, // 丢弃排在最前面（等待最久）的任务，加入新的任务
+    BLOCK        // 等待工作线程取出任务：调用者（reactor）暂停读取，由 TCP 的流量控制反压客户端
+};
+
+/**
+ * @brief 基于排队时间的准入控制（CoDel）
+ *
+ * 工作线程取出任务时记录队列中等待最久的任务的排队时间，一个 interval 内的最小值超过 target 时，
+ * 说明队列一直没有排空（不是短暂的突发），认为过载：丢弃排队超过 target 的任务，并改为先处理最新的任务（LIFO），
+ * 使新的请求仍然能够及时完成；之后一个 interval 内出现过低于 target 的排队时间（或者队列排空）时恢复 FIFO
+ *
+ */
+struct AdmissionControl
+{
+    std::chrono::microseconds target{0}; // 为 0 时不启用
+    std::chrono::microseconds interval = std::chrono::milliseconds(100);
 
-    std::vector<bool> stop;
-    std::vector<std::queue<std::function<void()>>> tasks;
-    std::vector<std::pair<std::mutex, std::condition_variable>> locks;
+    bool enabled() const
+    {return target.count() > 0;}
+};
 
+/**
+ * @brief 每个工作线程一个有界的任务队列
+ *
+ * 每个工作线程的队列最多 capacity / thread_num 个任务，即一个 TaskQueue（一个 reactor）合计最多 capacity 个；
+ * 任务优先交给 key 对应的工作线程，它的队列已满时交给其它有空间的工作线程，全部已满时按照 policy 处理
+ * 被丢弃的任务以 shed = true 调用（在调用 enqueue 的线程或工作线程中），只需要尽快回复（例如 OVERLOADED），不应执行实际的工作
+ *
+ */
+class TaskQueue
+{
 public:
-    TaskQueue(int thread_num, int max_task_count);
+    using task_t = std::function<void(bool shed)>;
+    using clock = std::chrono::steady_clock;
+
+    static constexpr size_t UNBOUNDED = 0;
+
+    TaskQueue(int thread_num, size_t capacity = UNBOUNDED, OverflowPolicy policy = OverflowPolicy::REJECT, AdmissionControl control = AdmissionControl());
 
     ~TaskQueue();
 
-    template <class F, class... Args>
-    auto enqueue(int key, F &&f, Args &&...args)
-        -> std::future<typename std::result_of<F(Args...)>::type>;
+    // 加入任务，新的任务被拒绝（已经以 shed = true 调用）时返回 false
+    bool enqueue(int key, task_t task);
+
+    // 所有工作线程排队中的任务数
+    size_t size() const
+    {return queued.load(std::memory_order_relaxed);}
+
+    // 第 worker 个工作线程排队中的任务数
+    size_t depth(int worker);
+
+    // 因队列已满、或者排队时间过长而被丢弃的任务数
+    uint64_t dropped() const
+    {return shed.load(std::memory_order_relaxed);}
+
+    // 当前处于过载状态（LIFO）的工作线程数
+    int overloaded() const
+    {return lifo.load(std::memory_order_relaxed);}
+
+private:
+    struct Item
+    {
+        task_t task;
+        clock::time_point enqueued; // 只在启用准入控制时记录
+    };
+
+    struct Worker
+    {
+        std::mutex lock;
+        std::condition_variable ready; // 有任务，或者已经停止
+        std::condition_variable space; // 队列有了空间（BLOCK）
+        std::deque<Item> tasks;
+        bool stop = false;
+
+        // 准入控制的状态
+        clock::time_point interval_end;                      // 当前 interval 结束的时间
+        clock::duration min_delay = clock::duration::zero(); // 当前 interval 内最小的排队时间
+        bool overloaded = false;                             // 是否处于过载状态（LIFO）
+    };
+
+    int thread_num;
+    const size_t worker_capacity; // 每个工作线程的队列的上限，为 UNBOUNDED 时不限制
+    const OverflowPolicy policy;
+    const AdmissionControl control;
+    std::vector<Worker> workers;
+    std::atomic<size_t> queued{0};
+    std::atomic<uint64_t> shed{0};
+    std::atomic<int> lifo{0};
+    ThreadPool pool; // 最后声明：析构时最先等待工作线程退出，之后才销毁 workers
+
+    bool full(const Worker &w) const
+    {return worker_capacity != UNBOUNDED && w.tasks.size() >= worker_capacity;}
+
+    // 在持有 w.lock 时加入任务，释放锁之后唤醒工作线程
+    void push(Worker &w, std::unique_lock<std::mutex> &lock, task_t &&task);
 
+    // 在持有 w.lock 时取出下一个要执行的任务，过载时把排队超过 target 的任务移入 expired
+    task_t pop(Worker &w, std::vector<task_t> &expired);
 };
 
-TaskQueue::TaskQueue(int thread_num, int max_task_count)
-    : thread_num(thread_num), max_task_count(max_task_count / thread_num), pool(thread_num), stop(thread_num, false), tasks(thread_num), locks(thread_num)
+TaskQueue::TaskQueue(int thread_num, size_t capacity, OverflowPolicy policy, AdmissionControl control)
+    : thread_num(thread_num), worker_capacity(capacity == UNBOUNDED ? UNBOUNDED : (capacity + thread_num - 1) / thread_num),
+      policy(policy), control(control), workers(thread_num), pool(thread_num)
 {
     for (size_t i = 0; i < thread_num; i++)
     {
         int j = i;
         pool.enqueue([this](int id){
+            Worker &w = this->workers[id];
+            std::vector<task_t> expired;
             while (true)
             {
-                std::function<void()> task;
+                task_t task;
                 {
-                    std::unique_lock<std::mutex> lock(this->locks[id].first);
-                    this->locks[id].second.wait(lock, [&]()
+                    std::unique_lock<std::mutex> lock(w.lock);
+                    if (w.tasks.empty())
                     {
-                        return this->stop[id] || !this->tasks[id].empty(); 
+                        // 队列排空过，不是持续的排队，退出过载状态
+                        w.min_delay = clock::duration::zero();
+                        if (w.overloaded)
+                        {
+                            w.overloaded = false;
+                            this->lifo.fetch_sub(1, std::memory_order_relaxed);
+                        }
+                    }
+                    w.ready.wait(lock, [&]()
+                    {
+                        return w.stop || !w.tasks.empty();
                     });
 
-                    if (this->stop[id] && this->tasks[id].empty())
+                    if (w.stop && w.tasks.empty())
                         return;
 
-                    task = std::move(this->tasks[id].front());
-                    this->tasks[id].pop();
+                    task = pop(w, expired);
+                }
+                this->queued.fetch_sub(1 + expired.size(), std::memory_order_relaxed);
+                if (this->policy == OverflowPolicy::BLOCK)
+                    w.space.notify_one();
+                if (!expired.empty())
+                {
+                    this->shed.fetch_add(expired.size(), std::memory_order_relaxed);
+                    for (auto &e : expired)
+                        e(true);
+                    expired.clear();
                 }
-                task();
+                task(false);
             }
         }, j);
     }
@@ -55,38 +163,126 @@ TaskQueue::TaskQueue(int thread_num, int max_task_count)
 
 TaskQueue::~TaskQueue()
 {
-    for (size_t i = 0; i < thread_num; i++)
+    // 工作线程处理完已经排队的任务后退出，pool 析构时等待它们
+    for (auto &w : workers)
     {
         {
-            std::unique_lock<std::mutex> lock(locks[i].first);
-            stop[i] = true;
+            std::unique_lock<std::mutex> lock(w.lock);
+            w.stop = true;
         }
-        locks[i].second.notify_all();
+        w.ready.notify_all();
+        w.space.notify_all();
     }
 }
 
-template <class F, class... Args>
-auto TaskQueue::enqueue(int key, F &&f, Args &&...args)
-    -> std::future<typename std::result_of<F(Args...)>::type>
+bool TaskQueue::enqueue(int key, task_t task)
 {
-    int pos = key % thread_num;
+    int first = key % thread_num;
+    for (int i = 0; i < thread_num; i++)
+    {
+        Worker &w = workers[(first + i) % thread_num];
+        std::unique_lock<std::mutex> lock(w.lock);
+        if (w.stop)
+            throw std::runtime_error("enqueue on stopped TaskQueue");
+        if (!full(w))
+        {
+            push(w, lock, std::move(task));
+            return true;
+        }
+    }
 
-    using return_type = typename std::result_of<F(Args...)>::type;
+    // 所有工作线程的队列都已满
+    Worker &w = workers[first];
+    std::unique_lock<std::mutex> lock(w.lock);
+    switch (policy)
+    {
+    case OverflowPolicy::DROP_OLDEST:
+    {
+        task_t oldest;
+        if (!w.tasks.empty())
+        {
+            oldest = std::move(w.tasks.front().task);
+            w.tasks.pop_front();
+            queued.fetch_sub(1, std::memory_order_relaxed);
+        }
+        push(w, lock, std::move(task));
+        if (oldest)
+        {
+            shed.fetch_add(1, std::memory_order_relaxed);
+            oldest(true);
+        }
+        return true;
+    }
+    case OverflowPolicy::BLOCK:
+        w.space.wait(lock, [&]()
+        {
+            return w.stop || !full(w);
+        });
+        if (w.stop)
+            throw std::runtime_error("enqueue on stopped TaskQueue");
+        push(w, lock, std::move(task));
+        return true;
+    default:
+        lock.unlock();
+        shed.fetch_add(1, std::memory_order_relaxed);
+        task(true);
+        return false;
+    }
+}
 
-    auto task = std::make_shared<std::packaged_task<return_type()>>(
-        std::bind(std::forward<F>(f), std::forward<Args>(args)...));
+size_t TaskQueue::depth(int worker)
+{
+    Worker &w = workers[worker % thread_num];
+    std::lock_guard<std::mutex> lock(w.lock);
+    return w.tasks.size();
+}
 
-    std::future<return_type> res = task->get_future();
+void TaskQueue::push(Worker &w, std::unique_lock<std::mutex> &lock, task_t &&task)
+{
+    w.tasks.push_back({std::move(task), control.enabled() ? clock::now() : clock::time_point()});
+    queued.fetch_add(1, std::memory_order_relaxed);
+    lock.unlock();
+    w.ready.notify_one();
+}
+
+TaskQueue::task_t TaskQueue::pop(Worker &w, std::vector<task_t> &expired)
+{
+    task_t task;
+    if (!control.enabled())
     {
-        std::unique_lock<std::mutex> lock(locks[pos].first);
+        task = std::move(w.tasks.front().task);
+        w.tasks.pop_front();
+        return task;
+    }
 
-        if (stop[pos])
-            throw std::runtime_error("enqueue on stopped TaskQueue");
-        else if (tasks.size() >= max_task_count)
-            throw std::runtime_error("too many tasks");
-        tasks[pos].emplace([task]()
-                           { (*task)(); });
+    // 等待最久的任务的排队时间即当前队列的延迟
+    auto now = clock::now();
+    auto delay = now - w.tasks.front().enqueued;
+    w.min_delay = std::min(w.min_delay, delay);
+    if (now >= w.interval_end)
+    {
+        bool overloaded = w.min_delay > control.target;
+        if (overloaded != w.overloaded)
+            lifo.fetch_add(overloaded ? 1 : -1, std::memory_order_relaxed);
+        w.overloaded = overloaded;
+        w.min_delay = delay;
+        w.interval_end = now + control.interval;
     }
-    locks[pos].second.notify_one();
-    return res;
-}
\ No newline at end of file
+
+    if (!w.overloaded)
+    {
+        task = std::move(w.tasks.front().task);
+        w.tasks.pop_front();
+        return task;
+    }
+
+    // 过载：排队超过 target 的任务已经来不及，直接丢弃，至少保留最新的一个
+    while (w.tasks.size() > 1 && now - w.tasks.front().enqueued > control.target)
+    {
+        expired.push_back(std::move(w.tasks.front().task));
+        w.tasks.pop_front();
+    }
+    task = std::move(w.tasks.back().task);
+    w.tasks.pop_back();
+    return task;
+}
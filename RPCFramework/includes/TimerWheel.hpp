@@ -0,0 +1,233 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <algorithm>
+
+/**
+ * @brief 定时器节点，嵌入在拥有它的对象中（例如连接），定时器本身不分配内存
+ *
+ */
+struct TimerNode
+{
+    TimerNode *prev = nullptr;
+    TimerNode *next = nullptr;
+    uint64_t expire = 0;   // 到期的 tick
+    void *owner = nullptr; // 拥有该节点的对象，到期时由调用者使用
+
+    // 是否已经加入了时间轮
+    bool pending() const
+    {return prev != nullptr;}
+};
+
+/**
+ * @brief 分层时间轮，只在一个线程中使用（例如 sub reactor）
+ *
+ * LEVELS 层，每层 SLOTS 个槽，第 i 层的一个槽跨越 SLOTS^i 个 tick；schedule、cancel 都是 O(1)
+ * 推进到高层的槽的边界时，把该槽中的节点重新放入低层；超过最高层范围的定时器先放在最远处，之后重新放置
+ *
+ */
+class TimerWheel
+{
+public:
+    using clock = std::chrono::steady_clock;
+
+    static constexpr unsigned LEVELS = 4;
+    static constexpr unsigned SLOT_BITS = 6;
+    static constexpr unsigned SLOTS = 1 << SLOT_BITS;
+    static constexpr uint64_t SLOT_MASK = SLOTS - 1;
+
+    explicit TimerWheel(std::chrono::milliseconds tick = std::chrono::milliseconds(1), clock::time_point start = clock::now());
+
+    TimerWheel(const TimerWheel &) = delete;
+    TimerWheel &operator=(const TimerWheel &) = delete;
+
+    // 在 when 时到期，node 已经加入时先取消；已经过去的时间在下一个 tick 到期
+    void schedule(TimerNode &node, clock::time_point when);
+
+    void cancel(TimerNode &node);
+
+    size_t size() const
+    {return count;}
+
+    // 距离下一次需要 advance 的毫秒数（不会晚于最早的定时器，可能更早），没有定时器时返回 -1
+    int timeout(clock::time_point now) const;
+
+    // 推进到 now，依次对到期的节点调用 fn(TimerNode &)，调用之前节点已经移出时间轮，fn 中可以重新 schedule
+    template <typename F>
+    void advance(clock::time_point now, F &&fn);
+
+private:
+    std::chrono::milliseconds tick;
+    clock::time_point start;
+    uint64_t current = 0; // 已经处理完的 tick
+    size_t count = 0;
+    TimerNode slots[LEVELS][SLOTS]; // 每个槽是以哨兵节点为头的双向循环链表
+
+    uint64_t toTick(clock::time_point t) const;
+
+    // 按照 expire 放入对应的层与槽，expire 不早于 current
+    void place(TimerNode &node);
+
+    static void link(TimerNode &head, TimerNode &node);
+    static void unlink(TimerNode &node);
+
+    // 取出一个槽中的所有节点，重新放置
+    void cascade(unsigned level);
+};
+
+inline TimerWheel::TimerWheel(std::chrono::milliseconds tick, clock::time_point start)
+    : tick(tick), start(start)
+{
+    for (auto &level : slots)
+        for (auto &head : level)
+            head.prev = head.next = &head;
+}
+
+inline uint64_t TimerWheel::toTick(clock::time_point t) const
+{
+    if (t <= start)
+        return 0;
+    return static_cast<uint64_t>((t - start) / tick);
+}
+
+inline void TimerWheel::schedule(TimerNode &node, clock::time_point when)
+{
+    if (node.pending())
+        cancel(node);
+    // 向上取整，不会提前到期
+    uint64_t expire = toTick(when);
+    if (start + tick * expire < when)
+        ++expire;
+    node.expire = expire > current ? expire : current + 1;
+    place(node);
+    ++count;
+}
+
+inline void TimerWheel::cancel(TimerNode &node)
+{
+    if (!node.pending())
+        return;
+    unlink(node);
+    --count;
+}
+
+inline int TimerWheel::timeout(clock::time_point now) const
+{
+    if (count == 0)
+        return -1;
+    // 每层中最近的非空槽：第 0 层为其到期的 tick，高层为其中的节点被放入低层的 tick，取最早的一个
+    uint64_t next = UINT64_MAX;
+    for (unsigned level = 0; level < LEVELS; level++)
+    {
+        unsigned shift = level * SLOT_BITS;
+        uint64_t base = current >> shift;
+        for (uint64_t d = 1; d < SLOTS; d++)
+        {
+            const TimerNode &head = slots[level][(base + d) & SLOT_MASK];
+            if (head.next != &head)
+            {
+                next = std::min(next, (base + d) << shift);
+                break;
+            }
+        }
+    }
+    auto due = start + tick * next;
+    if (due <= now)
+        return 0;
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(due - now).count();
+    return static_cast<int>(std::min<int64_t>(ms + 1, INT32_MAX));
+}
+
+template <typename F>
+void TimerWheel::advance(clock::time_point now, F &&fn)
+{
+    uint64_t target = toTick(now);
+    if (count == 0)
+    {
+        if (target > current)
+            current = target;
+        return;
+    }
+    while (current < target)
+    {
+        ++current;
+        // 到达高层的槽的边界时，先把该槽中的节点放入低层
+        for (unsigned level = 1; level < LEVELS; level++)
+        {
+            if ((current & ((uint64_t(1) << (level * SLOT_BITS)) - 1)) != 0)
+                break;
+            cascade(level);
+        }
+
+        // 先移到局部链表，fn 中可能重新 schedule，或者取消其它节点
+        TimerNode &head = slots[0][current & SLOT_MASK];
+        if (head.next == &head)
+            continue;
+        TimerNode expired;
+        expired.prev = head.prev;
+        expired.next = head.next;
+        expired.prev->next = &expired;
+        expired.next->prev = &expired;
+        head.prev = head.next = &head;
+        while (expired.next != &expired)
+        {
+            TimerNode &node = *expired.next;
+            unlink(node);
+            if (node.expire > current) // 超过最高层的范围，还没有到期
+            {
+                place(node);
+                continue;
+            }
+            --count;
+            fn(node);
+        }
+        if (count == 0)
+        {
+            current = target;
+            break;
+        }
+    }
+}
+
+inline void TimerWheel::place(TimerNode &node)
+{
+    for (unsigned level = 0; level < LEVELS; level++)
+    {
+        unsigned shift = level * SLOT_BITS;
+        if ((node.expire >> shift) - (current >> shift) < SLOTS)
+        {
+            link(slots[level][(node.expire >> shift) & SLOT_MASK], node);
+            return;
+        }
+    }
+    // 超过最高层的范围，先放在最高层的最远处，转到时重新放置
+    unsigned shift = (LEVELS - 1) * SLOT_BITS;
+    link(slots[LEVELS - 1][((current >> shift) + SLOTS - 1) & SLOT_MASK], node);
+}
+
+inline void TimerWheel::link(TimerNode &head, TimerNode &node)
+{
+    node.prev = head.prev;
+    node.next = &head;
+    head.prev->next = &node;
+    head.prev = &node;
+}
+
+inline void TimerWheel::unlink(TimerNode &node)
+{
+    node.prev->next = node.next;
+    node.next->prev = node.prev;
+    node.prev = node.next = nullptr;
+}
+
+inline void TimerWheel::cascade(unsigned level)
+{
+    TimerNode &head = slots[level][(current >> (level * SLOT_BITS)) & SLOT_MASK];
+    while (head.next != &head)
+    {
+        TimerNode &node = *head.next;
+        unlink(node);
+        place(node);
+    }
+}